@@ -25,6 +25,8 @@
 #include <FL/Fl_System_Driver.H>
 #include <FL/Fl_Window.H>
 #include <FL/Fl_Tooltip.H>
+#include <FL/Fl_Profiler.H>
+#include <FL/Fl_Input_Trace.H>
 #include <FL/fl_draw.H>
 
 #include <ctype.h>
@@ -136,7 +138,8 @@ int		Fl::damage_,
 		Fl::e_is_click,
 		Fl::e_keysym,
                 Fl::e_original_keysym,
-		Fl::scrollbar_size_ = 16;
+		Fl::scrollbar_size_ = 16,
+		Fl::e_compression = FL_COMPRESS_MOTION | FL_COMPRESS_CONFIGURE;
 
 char		*Fl::e_text = (char *)"";
 int		Fl::e_length;
@@ -418,7 +421,9 @@ void Fl::run_checks()
     while (next_check) {
       Check* checkp = next_check;
       next_check = checkp->next;
+      double t0 = Fl_Profiler::start_();
       (checkp->cb)(checkp->arg);
+      if (t0) Fl_Profiler::stop_(Fl_Profiler::CHECK, (Fl_Profiler::Function)checkp->cb, 0, t0);
     }
     next_check = first_check;
   }
@@ -653,6 +658,121 @@ void Fl::redraw() {
   for (Fl_X* i = Fl_X::first; i; i = i->next) i->w->redraw();
 }
 
+////////////////////////////////////////////////////////////////
+// Frame pacing:
+
+static double frame_interval;   // 0 if frames are not paced
+static char frame_due = 1;      // the next frame may be drawn now
+static char frame_input;        // an input event was handled since the last frame
+static Fl_Frame_Stats frame_stats_;
+
+struct Frame_Handler {
+  Fl_Frame_Handler cb;
+  void *data;
+  Frame_Handler *next;
+};
+static Frame_Handler *frame_handlers;
+
+static void frame_timeout(void*) {
+  frame_due = 1;
+}
+
+static void call_frame_handlers(int phase) {
+  for (Frame_Handler *h = frame_handlers; h;) {
+    Frame_Handler *next = h->next; // h may be removed by the handler
+    h->cb(phase, h->data);
+    h = next;
+  }
+}
+
+/**
+  Sets the maximum number of frames per second drawn by the event loop.
+
+  By default (\p fps is 0) Fl::wait() calls Fl::flush() every time it
+  handles events, so a program that calls redraw() for every message it
+  receives draws as often as messages arrive. With a frame rate, damage
+  is accumulated and the windows are drawn at most \p fps times per second,
+  on a steady schedule. Damage caused by user input (mouse and keyboard
+  events) is still drawn immediately, so the program stays responsive.
+
+  Calling Fl::flush() directly always draws.
+
+  \see Fl::frame_stats(), Fl::add_frame_handler()
+*/
+void Fl::frame_rate(double fps) {
+  frame_interval = fps > 0 ? 1.0 / fps : 0.0;
+  if (!frame_interval) {
+    Fl::remove_timeout(frame_timeout);
+    frame_due = 1;
+  }
+}
+
+/** Returns the maximum number of frames per second, or 0 if frames are not paced. */
+double Fl::frame_rate() {
+  return frame_interval > 0 ? 1.0 / frame_interval : 0.0;
+}
+
+/**
+  Adds a function called at the start of every frame drawn by Fl::flush().
+
+  The handler is called twice per frame, with FL_FRAME_LAYOUT and then
+  with FL_FRAME_DRAW, before any window is drawn. It can change widgets
+  and damage them, which is drawn in the same frame. It is only called
+  when some window needs drawing.
+*/
+void Fl::add_frame_handler(Fl_Frame_Handler h, void *data) {
+  Frame_Handler *l = new Frame_Handler;
+  l->cb = h;
+  l->data = data;
+  l->next = 0;
+  Frame_Handler **p = &frame_handlers;
+  while (*p) p = &((*p)->next);
+  *p = l;
+}
+
+/** Removes a function added with Fl::add_frame_handler(). */
+void Fl::remove_frame_handler(Fl_Frame_Handler h, void *data) {
+  for (Frame_Handler **p = &frame_handlers; *p; p = &((*p)->next)) {
+    Frame_Handler *l = *p;
+    if (l->cb == h && l->data == data) {
+      *p = l->next;
+      delete l;
+      return;
+    }
+  }
+}
+
+/**
+  Gets statistics about the frames drawn by Fl::flush().
+  If \p reset is non-zero, the statistics start again from zero.
+*/
+void Fl::frame_stats(Fl_Frame_Stats &stats, int reset) {
+  stats = frame_stats_;
+  if (reset) memset(&frame_stats_, 0, sizeof(frame_stats_));
+}
+
+// Called by the event loop when it is about to draw. Unlike Fl::flush()
+// this waits for the next frame if Fl::frame_rate() is set.
+void fl_flush_frame() {
+  if (!frame_due && !frame_input && Fl::damage()) {
+    // the frame timeout will wake up Fl::wait() when it is time to draw
+    frame_stats_.deferred++;
+    Fl::screen_driver()->flush();
+    return;
+  }
+  Fl::flush();
+}
+
+// Called by Fl::handle() for every event.
+static void frame_event(int e) {
+  switch (e) {
+    case FL_PUSH: case FL_RELEASE: case FL_DRAG: case FL_MOVE:
+    case FL_MOUSEWHEEL: case FL_KEYDOWN: case FL_KEYUP: case FL_SHORTCUT:
+      frame_input = 1;
+      break;
+  }
+}
+
 /**
   Causes all the windows that need it to be redrawn and graphics forced
   out through the pipes.
@@ -665,15 +785,23 @@ void Fl::redraw() {
   event queue.
 */
 void Fl::flush() {
-  if (damage()) {
+  Fl_Group::flush_layout();
+  int drawn = damage();
+  if (drawn) {
+    double start = system_driver()->monotonic_clock();
+    call_frame_handlers(FL_FRAME_LAYOUT);
+    Fl_Group::flush_layout();
+    call_frame_handlers(FL_FRAME_DRAW);
     damage_ = 0;
     for (Fl_X* i = Fl_X::first; i; i = i->next) {
       Fl_Window* wi = i->w;
       if (wi->driver()->wait_for_expose_value) {damage_ = 1; continue;}
       if (!wi->visible_r()) continue;
       if (wi->damage()) {
+        double t0 = Fl_Profiler::start_();
         wi->driver()->flush();
         wi->clear_damage();
+        if (t0) Fl_Profiler::stop_(Fl_Profiler::FLUSH, 0, wi, t0);
       }
       // destroy damage regions for windows that don't use them:
       if (i->region) {
@@ -681,8 +809,20 @@ void Fl::flush() {
         i->region = 0;
       }
     }
+    double t = system_driver()->monotonic_clock() - start;
+    frame_stats_.frames++;
+    frame_stats_.last = t;
+    frame_stats_.average += (t - frame_stats_.average) / frame_stats_.frames;
+    if (t > frame_stats_.maximum) frame_stats_.maximum = t;
+    frame_input = 0;
+    if (frame_interval > 0) {
+      frame_due = 0;
+      Fl::remove_timeout(frame_timeout);
+      Fl::add_timeout(frame_interval, frame_timeout);
+    }
   }
   screen_driver()->flush();
+  if (drawn && Fl_Input_Trace::enabled()) Fl_Input_Trace::flushed_();
 }
 
 
@@ -1122,6 +1262,35 @@ void Fl::event_dispatch(Fl_Event_Dispatch d)
 }
 
 
+/**
+ \brief Sets the event types merged by the event loop.
+
+ When the system delivers events faster than the program handles them,
+ for instance during a fast drag or an interactive window resize, the
+ event loop can drop events that are immediately followed by a newer
+ event of the same type for the same window:
+
+ - FL_COMPRESS_MOTION: only the last of consecutive mouse motion events
+   is handled, with its position and button state. FL_MOVE and FL_DRAG
+   are sent once per batch of events.
+ - FL_COMPRESS_CONFIGURE: only the last of consecutive window move and
+   resize notifications is handled, so the window is laid out and drawn
+   once for its final geometry.
+
+ Both are on by default. Use 0 to handle every event, e.g. in a drawing
+ program that needs every point of the mouse path. Merged events are not
+ passed to the handlers added with Fl::add_system_handler().
+
+ \note Event compression is only implemented on the X11 platform.
+
+ \param mask a combination of Fl_Event_Compression flags
+ */
+void Fl::event_compression(int mask)
+{
+  e_compression = mask;
+}
+
+
 /**
  \brief Return the current event dispatch function.
  */
@@ -1149,11 +1318,12 @@ Fl_Event_Dispatch Fl::event_dispatch()
  */
 int Fl::handle(int e, Fl_Window* window)
 {
-  if (e_dispatch) {
-    return e_dispatch(e, window);
-  } else {
-    return handle_(e, window);
-  }
+  frame_event(e);
+  Fl_Group::flush_layout();
+  int traced = Fl_Input_Trace::enabled() && Fl_Input_Trace::begin_(e);
+  int ret = e_dispatch ? e_dispatch(e, window) : handle_(e, window);
+  if (traced) Fl_Input_Trace::end_();
+  return ret;
 }
 
 
@@ -1497,6 +1667,7 @@ void Fl_Widget::damage(uchar fl) {
     // damage entire window by deleting the region:
     Fl_X* i = Fl_X::i((Fl_Window*)this);
     if (!i) return; // window not mapped, so ignore it
+    if (Fl_Input_Trace::enabled()) Fl_Input_Trace::damage_(this);
     if (i->region) {
       fl_graphics_driver->XDestroyRegion(i->region);
       i->region = 0;
@@ -1506,6 +1677,68 @@ void Fl_Widget::damage(uchar fl) {
   }
 }
 
+// Cost of one more damage rectangle, in pixels. Two rectangles are merged
+// if their bounding box covers less than this many undamaged pixels.
+#define DAMAGE_RECT_COST 4096
+
+// Returns the number of undamaged pixels covered by the bounding box of a and b
+static long damage_rect_waste(const Fl_Rect &a, const Fl_Rect &b) {
+  int x = a.x() < b.x() ? a.x() : b.x();
+  int y = a.y() < b.y() ? a.y() : b.y();
+  int r = a.r() > b.r() ? a.r() : b.r();
+  int t = a.b() > b.b() ? a.b() : b.b();
+  return long(r - x) * (t - y) - long(a.w()) * a.h() - long(b.w()) * b.h();
+}
+
+// Adds a rectangle to the damage rectangles of a window and rebuilds its
+// region from them. Rectangles that overlap, or whose union is cheaper
+// than drawing them separately, are merged until the list is disjoint;
+// when the list is full the new rectangle is merged with the cheapest one.
+static void add_damage_rect(Fl_X *i, Fl_Rect r) {
+  for (int n = 0; n < i->damage_rects;) {
+    const Fl_Rect &d = i->damage_rect[n];
+    if (d.x() <= r.x() && d.y() <= r.y() && d.r() >= r.r() && d.b() >= r.b())
+      return; // already damaged
+    bool overlap = d.x() < r.r() && r.x() < d.r() && d.y() < r.b() && r.y() < d.b();
+    if (overlap || damage_rect_waste(d, r) < DAMAGE_RECT_COST) {
+      int x = d.x() < r.x() ? d.x() : r.x();
+      int y = d.y() < r.y() ? d.y() : r.y();
+      int R = d.r() > r.r() ? d.r() : r.r();
+      int B = d.b() > r.b() ? d.b() : r.b();
+      r = Fl_Rect(x, y, R - x, B - y);
+      i->damage_rect[n] = i->damage_rect[--i->damage_rects];
+      n = 0; // the union may touch rectangles already checked
+      continue;
+    }
+    n++;
+    if (n == i->damage_rects && n == Fl_X::MAX_DAMAGE_RECTS) {
+      int best = 0;
+      long best_waste = damage_rect_waste(i->damage_rect[0], r);
+      for (int m = 1; m < n; m++) {
+        long w = damage_rect_waste(i->damage_rect[m], r);
+        if (w < best_waste) {best = m; best_waste = w;}
+      }
+      // force the merge with the cheapest rectangle:
+      const Fl_Rect &b = i->damage_rect[best];
+      int x = b.x() < r.x() ? b.x() : r.x();
+      int y = b.y() < r.y() ? b.y() : r.y();
+      int R = b.r() > r.r() ? b.r() : r.r();
+      int B = b.b() > r.b() ? b.b() : r.b();
+      r = Fl_Rect(x, y, R - x, B - y);
+      i->damage_rect[best] = i->damage_rect[--i->damage_rects];
+      n = 0;
+    }
+  }
+  i->damage_rect[i->damage_rects++] = r;
+  fl_graphics_driver->XDestroyRegion(i->region);
+  const Fl_Rect &f = i->damage_rect[0];
+  i->region = fl_graphics_driver->XRectangleRegion(f.x(), f.y(), f.w(), f.h());
+  for (int n = 1; n < i->damage_rects; n++) {
+    const Fl_Rect &d = i->damage_rect[n];
+    fl_graphics_driver->add_rectangle_to_region(i->region, d.x(), d.y(), d.w(), d.h());
+  }
+}
+
 void Fl_Widget::damage(uchar fl, int X, int Y, int W, int H) {
   Fl_Widget* wi = this;
   // mark all parent widgets between this and window with FL_DAMAGE_CHILD:
@@ -1524,6 +1757,7 @@ void Fl_Widget::damage(uchar fl, int X, int Y, int W, int H) {
   if (W > wi->w()-X) W = wi->w()-X;
   if (H > wi->h()-Y) H = wi->h()-Y;
   if (W <= 0 || H <= 0) return;
+  if (Fl_Input_Trace::enabled()) Fl_Input_Trace::damage_(this);
 
   if (!X && !Y && W==wi->w() && H==wi->h()) {
     // if damage covers entire window delete region:
@@ -1534,13 +1768,18 @@ void Fl_Widget::damage(uchar fl, int X, int Y, int W, int H) {
   if (wi->damage()) {
     // if we already have damage we must merge with existing region:
     if (i->region) {
-      fl_graphics_driver->add_rectangle_to_region(i->region, X, Y, W, H);
+      if (i->damage_rects)
+        add_damage_rect(i, Fl_Rect(X, Y, W, H));
+      else
+        fl_graphics_driver->add_rectangle_to_region(i->region, X, Y, W, H);
     }
     wi->damage_ |= fl;
   } else {
     // create a new region:
     if (i->region) fl_graphics_driver->XDestroyRegion(i->region);
     i->region = fl_graphics_driver->XRectangleRegion(X,Y,W,H);
+    i->damage_rect[0] = Fl_Rect(X, Y, W, H);
+    i->damage_rects = 1;
     wi->damage_ = fl;
   }
   Fl::damage(FL_DAMAGE_CHILD);
@@ -1635,9 +1874,59 @@ void Fl::do_widget_deletion() {
 }
 
 
-static Fl_Widget ***widget_watch = 0;
+// The watched pointers are kept in two hash tables sharing the same
+// nodes: one by address of the pointer, to watch and release it, and one
+// by widget, to clear the pointers when the widget is destroyed.
+struct Widget_Watch {
+  Fl_Widget **wp;             // the watched pointer
+  const Fl_Widget *widget;    // what it pointed to, 0 once cleared
+  Widget_Watch *next_wp;      // next in the same wp bucket
+  Widget_Watch *next_widget;  // next in the same widget bucket
+};
+
+static Widget_Watch **watch_by_wp = 0;
+static Widget_Watch **watch_by_widget = 0;
+static Widget_Watch *watch_freelist = 0;
 static int num_widget_watch = 0;
-static int max_widget_watch = 0;
+static int watch_size = 0; // number of buckets in each table, a power of 2
+
+static unsigned watch_hash(const void *p) {
+  fl_uintptr_t h = (fl_uintptr_t)p;
+  h ^= h >> 4; // pointers are aligned
+  h ^= h >> 12;
+  return (unsigned)h & (watch_size - 1);
+}
+
+static void watch_rehash(int size) {
+  Widget_Watch **old = watch_by_wp;
+  int old_size = watch_size;
+  watch_size = size;
+  watch_by_wp = (Widget_Watch**)calloc(size, sizeof(Widget_Watch*));
+  free(watch_by_widget);
+  watch_by_widget = (Widget_Watch**)calloc(size, sizeof(Widget_Watch*));
+  for (int i = 0; i < old_size; i++) {
+    for (Widget_Watch *n = old[i], *next; n; n = next) {
+      next = n->next_wp;
+      unsigned h = watch_hash(n->wp);
+      n->next_wp = watch_by_wp[h];
+      watch_by_wp[h] = n;
+      if (n->widget) {
+        h = watch_hash(n->widget);
+        n->next_widget = watch_by_widget[h];
+        watch_by_widget[h] = n;
+      }
+    }
+  }
+  free(old);
+}
+
+// removes a node from the widget table
+static void watch_unlink_widget(Widget_Watch *n) {
+  Widget_Watch **p = &watch_by_widget[watch_hash(n->widget)];
+  while (*p != n) p = &((*p)->next_widget);
+  *p = n->next_widget;
+  n->widget = 0;
+}
 
 
 /**
@@ -1656,6 +1945,9 @@ static int max_widget_watch = 0;
   After accessing the widget, the widget pointer must be released from the
   watch list by calling Fl::release_widget_pointer().
 
+  The pointer must not be changed while it is watched: the watch list finds
+  it through the widget it pointed to when it was added.
+
   Example for a button that is clicked (from its handle() method):
   \code
     Fl_Widget *wp = this;		// save 'this' in a pointer variable
@@ -1688,15 +1980,25 @@ static int max_widget_watch = 0;
 void Fl::watch_widget_pointer(Fl_Widget *&w)
 {
   Fl_Widget **wp = &w;
-  int i;
-  for (i=0; i<num_widget_watch; ++i) {
-    if (widget_watch[i]==wp) return;
+  if (watch_size) {
+    for (Widget_Watch *n = watch_by_wp[watch_hash(wp)]; n; n = n->next_wp)
+      if (n->wp == wp) return;
   }
-  if (num_widget_watch==max_widget_watch) {
-    max_widget_watch += 8;
-    widget_watch = (Fl_Widget***)realloc(widget_watch, sizeof(Fl_Widget**)*max_widget_watch);
+  if (num_widget_watch >= watch_size) watch_rehash(watch_size ? 2 * watch_size : 64);
+  Widget_Watch *n = watch_freelist;
+  if (n) watch_freelist = n->next_wp;
+  else n = (Widget_Watch*)malloc(sizeof(Widget_Watch));
+  n->wp = wp;
+  n->widget = w;
+  unsigned h = watch_hash(wp);
+  n->next_wp = watch_by_wp[h];
+  watch_by_wp[h] = n;
+  if (w) {
+    h = watch_hash(w);
+    n->next_widget = watch_by_widget[h];
+    watch_by_widget[h] = n;
   }
-  widget_watch[num_widget_watch++] = wp;
+  num_widget_watch++;
 #ifdef DEBUG_WATCH
   printf ("\nwatch_widget_pointer:   (%d/%d) %8p => %8p\n",
     num_widget_watch,num_widget_watch,wp,*wp);
@@ -1718,20 +2020,21 @@ void Fl::watch_widget_pointer(Fl_Widget *&w)
 void Fl::release_widget_pointer(Fl_Widget *&w)
 {
   Fl_Widget **wp = &w;
-  int i,j=0;
-  for (i=0; i<num_widget_watch; ++i) {
-    if (widget_watch[i]!=wp) {
-      if (j<i) widget_watch[j] = widget_watch[i]; // fill gap
-      j++;
-    }
+  if (!num_widget_watch) return;
+  for (Widget_Watch **p = &watch_by_wp[watch_hash(wp)]; *p; p = &((*p)->next_wp)) {
+    Widget_Watch *n = *p;
+    if (n->wp != wp) continue;
 #ifdef DEBUG_WATCH
-    else { // found widget pointer
-      printf ("release_widget_pointer: (%d/%d) %8p => %8p\n",
-	i+1,num_widget_watch,wp,*wp);
-    }
+    printf ("release_widget_pointer: (%d) %8p => %8p\n",
+      num_widget_watch,wp,*wp);
 #endif //DEBUG_WATCH
+    *p = n->next_wp;
+    if (n->widget) watch_unlink_widget(n);
+    n->next_wp = watch_freelist;
+    watch_freelist = n;
+    num_widget_watch--;
+    break;
   }
-  num_widget_watch = j;
 #ifdef DEBUG_WATCH
   printf ("                        num_widget_watch = %d\n\n",num_widget_watch);
   fflush(stdout);
@@ -1748,8 +2051,8 @@ void Fl::release_widget_pointer(Fl_Widget *&w)
 
   \note Internal use only !
 
-  This method searches the widget watch list for pointers to the widget and
-  clears each pointer that points to it. Widget pointers can be added to the
+  This method looks up the pointers to the widget in the widget watch list
+  and clears each of them. Widget pointers can be added to the
   widget watch list by calling Fl::watch_widget_pointer() or by using the
   helper class Fl_Widget_Tracker (recommended).
 
@@ -1758,12 +2061,14 @@ void Fl::release_widget_pointer(Fl_Widget *&w)
 */
 void Fl::clear_widget_pointer(Fl_Widget const *w)
 {
-  if (w==0L) return;
-  int i;
-  for (i=0; i<num_widget_watch; ++i) {
-    if (widget_watch[i] && *widget_watch[i]==w) {
-      *widget_watch[i] = 0L;
-    }
+  if (w==0L || !num_widget_watch) return;
+  Widget_Watch **p = &watch_by_widget[watch_hash(w)];
+  while (*p) {
+    Widget_Watch *n = *p;
+    if (n->widget != w) {p = &n->next_widget; continue;}
+    if (*n->wp == w) *n->wp = 0L;
+    *p = n->next_widget; // n stays in the wp table until it is released
+    n->widget = 0;
   }
 }
 
@@ -32,29 +32,547 @@
 // so that the number of items in the browser and size of those items
 // is unlimited. The only problem is that the old browser used an
 // index number to identify a line, and it is slow to convert from/to
-// a pointer. I use a cache of the last match to try to speed this up.
+// a pointer. The lines are also listed in an index, see Fl_Browser_Index.
 
 // Also added the ability to "hide" a line. This sets its height to
 // zero, so the Fl_Browser_ cannot pick it.
 
 #define SELECTED 1
 #define NOTDISPLAYED 2
+#define ARENA 4		// in an arena block, not allocated by itself
+#define PARSED 8	// format codes parsed, see line_format()
 
 // WARNING:
 //       Fl_File_Chooser.cxx also has a definition of this structure (FL_BLINE).
 //       Changes to FL_BLINE *must* be reflected in Fl_File_Chooser.cxx as well.
 //       This hack in Fl_File_Chooser should be solved.
 //
+struct Fl_Browser_Block;
+struct Fl_Browser_Format;
+
 struct FL_BLINE {	// data is in a linked list of these
   FL_BLINE* prev;
   FL_BLINE* next;
   void* data;
   Fl_Image* icon;
+  Fl_Browser_Block* block; // block of the index listing this line
+  Fl_Browser_Format* format; // parsed format codes, NULL if none
   short length;		// sizeof(txt)-1, may be longer than string
   char flags;		// selected, displayed
   char txt[1];		// start of allocated array
 };
 
+////////////////////////////////////////////////////////////////
+// Line index:
+
+// The lines are listed in order in blocks of at most BLOCK_SIZE pointers,
+// and each line points to its block. A Fenwick tree of the number of
+// lines in each block gives the line number of the first line of a
+// block, so finding the line with a given number, or the number of a
+// line, takes O(log n) time. Inserting or removing a line only changes
+// its block, unless the block is split because it is full or removed
+// because it is empty, which renumbers the blocks.
+// The index is built when a line is first looked up, and is then kept
+// up to date until the browser is cleared.
+
+// The blocks may also hold the height of each line, with a second tree
+// of the block heights, to find the line at a scrolling position, or the
+// position of a line, the same way. The heights are filled in the first
+// time a position is looked up, and dropped when the text size changes.
+
+#define BLOCK_SIZE 128
+
+struct Fl_Browser_Block {
+  int index;		// position in the list of blocks
+  int n;		// number of lines
+  FL_BLINE* line[BLOCK_SIZE];
+  int h[BLOCK_SIZE];	// height of each line, if known
+};
+
+class Fl_Browser_Index {
+  Fl_Browser_Block **block_;
+  int nblock_, ablock_;
+  int *tree_;		// Fenwick tree of the block sizes, 1 based
+  int *htree_;		// Fenwick tree of the block heights, 1 based
+  int built_;
+  int heights_;		// the line heights are known
+
+  static void add(int *tree, int n, int b, int d) {
+    for (b++; b <= n; b += b & -b) tree[b] += d;
+  }
+  static int sum(const int *tree, int b) { // sum of the first b blocks
+    int s = 0;
+    for (; b > 0; b -= b & -b) s += tree[b];
+    return s;
+  }
+  static int lower(const int *tree, int n, int &v);
+  void renumber(int from);
+  Fl_Browser_Block *new_block(int at);
+  static int position(const Fl_Browser_Block *b, const FL_BLINE *l) {
+    int i = 0;
+    while (b->line[i] != l) i++;
+    return i;
+  }
+public:
+  Fl_Browser_Index() : block_(0), nblock_(0), ablock_(0), tree_(0), htree_(0), built_(0), heights_(0) {}
+  ~Fl_Browser_Index() {
+    clear();
+    free(block_);
+    free(tree_);
+    free(htree_);
+  }
+  int built() const {return built_;}
+  int heights() const {return heights_;}
+  void build(FL_BLINE *first);
+  void heights(const int *h);
+  void drop_heights() {heights_ = 0;}
+  void clear();
+  FL_BLINE *find(int line) const;
+  int lineno(const FL_BLINE *l) const;
+  FL_BLINE *find_position(int pos, int &item_pos) const;
+  int position(const FL_BLINE *l) const;
+  void insert(FL_BLINE *item, FL_BLINE *before, int h);
+  void remove(FL_BLINE *item);
+  void replace(FL_BLINE *item, FL_BLINE *with);
+  void swap(FL_BLINE *a, FL_BLINE *b);
+  void resized(FL_BLINE *item, int dh);
+};
+
+// finds the last block whose start is <= v, and subtracts that start
+// from v, returns n if v is past the end
+int Fl_Browser_Index::lower(const int *tree, int n, int &v) {
+  int b = 0, step = 1;
+  while (2 * step <= n) step *= 2;
+  for (; step; step /= 2) {
+    if (b + step <= n && tree[b + step] <= v) {
+      b += step;
+      v -= tree[b];
+    }
+  }
+  return b;
+}
+
+// numbers the blocks from the given one, and rebuilds the trees
+void Fl_Browser_Index::renumber(int from) {
+  int b;
+  for (b = from; b < nblock_; b++) block_[b]->index = b;
+  for (b = 1; b <= nblock_; b++) tree_[b] = htree_[b] = 0;
+  for (b = 1; b <= nblock_; b++) {
+    Fl_Browser_Block *bl = block_[b-1];
+    tree_[b] += bl->n;
+    if (heights_) for (int i = 0; i < bl->n; i++) htree_[b] += bl->h[i];
+    int p = b + (b & -b);
+    if (p <= nblock_) {tree_[p] += tree_[b]; htree_[p] += htree_[b];}
+  }
+}
+
+// inserts an empty block at the given position, the caller must renumber
+Fl_Browser_Block *Fl_Browser_Index::new_block(int at) {
+  if (nblock_ >= ablock_) {
+    ablock_ = ablock_ ? 2 * ablock_ : 16;
+    block_ = (Fl_Browser_Block**)realloc(block_, ablock_ * sizeof(Fl_Browser_Block*));
+    tree_ = (int*)realloc(tree_, (ablock_ + 1) * sizeof(int));
+    htree_ = (int*)realloc(htree_, (ablock_ + 1) * sizeof(int));
+  }
+  memmove(block_ + at + 1, block_ + at, (nblock_ - at) * sizeof(Fl_Browser_Block*));
+  Fl_Browser_Block *b = (Fl_Browser_Block*)malloc(sizeof(Fl_Browser_Block));
+  b->n = 0;
+  block_[at] = b;
+  nblock_++;
+  return b;
+}
+
+// lists the lines, filling the blocks by half so that inserting lines
+// does not split them at once
+void Fl_Browser_Index::build(FL_BLINE *first) {
+  clear();
+  Fl_Browser_Block *b = 0;
+  for (FL_BLINE *l = first; l; l = l->next) {
+    if (!b || b->n >= BLOCK_SIZE / 2) b = new_block(nblock_);
+    b->line[b->n++] = l;
+    l->block = b;
+  }
+  renumber(0);
+  built_ = 1;
+}
+
+// sets the height of all lines, in order
+void Fl_Browser_Index::heights(const int *h) {
+  for (int b = 0; b < nblock_; b++) {
+    Fl_Browser_Block *bl = block_[b];
+    memcpy(bl->h, h, bl->n * sizeof(int));
+    h += bl->n;
+  }
+  heights_ = 1;
+  renumber(0);
+}
+
+void Fl_Browser_Index::clear() {
+  for (int b = 0; b < nblock_; b++) free(block_[b]);
+  nblock_ = 0;
+  built_ = heights_ = 0;
+}
+
+// returns the line with the given number, 1 based, or NULL
+FL_BLINE *Fl_Browser_Index::find(int line) const {
+  if (line < 1) return 0;
+  line--;
+  int b = lower(tree_, nblock_, line);
+  if (b >= nblock_) return 0;
+  return block_[b]->line[line];
+}
+
+// returns the number of a listed line, 1 based
+int Fl_Browser_Index::lineno(const FL_BLINE *l) const {
+  const Fl_Browser_Block *b = l->block;
+  return sum(tree_, b->index) + position(b, l) + 1;
+}
+
+// returns the line covering the scrolling position pos and sets item_pos
+// to its top, or the last line if pos is past the end
+FL_BLINE *Fl_Browser_Index::find_position(int pos, int &item_pos) const {
+  if (!nblock_) return 0;
+  if (pos < 0) pos = 0;
+  int v = pos;
+  int b = lower(htree_, nblock_, v);
+  if (b >= nblock_) { // past the end
+    Fl_Browser_Block *bl = block_[nblock_-1];
+    FL_BLINE *l = bl->line[bl->n-1];
+    item_pos = position(l);
+    return l;
+  }
+  Fl_Browser_Block *bl = block_[b];
+  int y = pos - v;
+  int i = 0;
+  for (; i < bl->n - 1 && v >= bl->h[i]; i++) {v -= bl->h[i]; y += bl->h[i];}
+  item_pos = y;
+  return bl->line[i];
+}
+
+// returns the scrolling position of the top of a listed line
+int Fl_Browser_Index::position(const FL_BLINE *l) const {
+  const Fl_Browser_Block *b = l->block;
+  int y = sum(htree_, b->index);
+  for (int i = 0; b->line[i] != l; i++) y += b->h[i];
+  return y;
+}
+
+// lists item before the line \p before, or at the end if NULL,
+// h is its height if the heights are known
+void Fl_Browser_Index::insert(FL_BLINE *item, FL_BLINE *before, int h) {
+  Fl_Browser_Block *b;
+  int i;
+  if (before) {
+    b = before->block;
+    i = position(b, before);
+  } else {
+    if (!nblock_ || block_[nblock_-1]->n >= BLOCK_SIZE) {
+      new_block(nblock_);
+      renumber(nblock_ - 1);
+    }
+    b = block_[nblock_-1];
+    i = b->n;
+  }
+  if (b->n >= BLOCK_SIZE) { // split the block in two
+    Fl_Browser_Block *c = new_block(b->index + 1);
+    c->n = b->n - BLOCK_SIZE / 2;
+    b->n = BLOCK_SIZE / 2;
+    memcpy(c->line, b->line + b->n, c->n * sizeof(FL_BLINE*));
+    memcpy(c->h, b->h + b->n, c->n * sizeof(int));
+    for (int j = 0; j < c->n; j++) c->line[j]->block = c;
+    renumber(b->index + 1);
+    if (i > b->n) {i -= b->n; b = c;}
+  }
+  memmove(b->line + i + 1, b->line + i, (b->n - i) * sizeof(FL_BLINE*));
+  memmove(b->h + i + 1, b->h + i, (b->n - i) * sizeof(int));
+  b->line[i] = item;
+  b->h[i] = heights_ ? h : 0;
+  b->n++;
+  item->block = b;
+  add(tree_, nblock_, b->index, 1);
+  if (heights_) add(htree_, nblock_, b->index, h);
+}
+
+void Fl_Browser_Index::remove(FL_BLINE *item) {
+  Fl_Browser_Block *b = item->block;
+  int i = position(b, item);
+  int h = b->h[i];
+  b->n--;
+  memmove(b->line + i, b->line + i + 1, (b->n - i) * sizeof(FL_BLINE*));
+  memmove(b->h + i, b->h + i + 1, (b->n - i) * sizeof(int));
+  if (b->n) {
+    add(tree_, nblock_, b->index, -1);
+    if (heights_) add(htree_, nblock_, b->index, -h);
+  } else {
+    int at = b->index;
+    free(b);
+    nblock_--;
+    memmove(block_ + at, block_ + at + 1, (nblock_ - at) * sizeof(Fl_Browser_Block*));
+    renumber(at);
+  }
+}
+
+// puts the line \p with at the place of \p item
+void Fl_Browser_Index::replace(FL_BLINE *item, FL_BLINE *with) {
+  Fl_Browser_Block *b = item->block;
+  b->line[position(b, item)] = with;
+  with->block = b;
+}
+
+void Fl_Browser_Index::swap(FL_BLINE *a, FL_BLINE *b) {
+  Fl_Browser_Block *ba = a->block, *bb = b->block;
+  int ia = position(ba, a), ib = position(bb, b);
+  int ha = ba->h[ia], hb = bb->h[ib];
+  ba->line[ia] = b; ba->h[ia] = hb; b->block = ba;
+  bb->line[ib] = a; bb->h[ib] = ha; a->block = bb;
+  if (heights_ && ba != bb) {
+    add(htree_, nblock_, ba->index, hb - ha);
+    add(htree_, nblock_, bb->index, ha - hb);
+  }
+}
+
+// changes the height of a line by dh
+void Fl_Browser_Index::resized(FL_BLINE *item, int dh) {
+  if (!heights_ || !dh) return;
+  Fl_Browser_Block *b = item->block;
+  b->h[position(b, item)] += dh;
+  add(htree_, nblock_, b->index, dh);
+}
+
+////////////////////////////////////////////////////////////////
+// Lines added in bulk:
+
+// add_lines() and load() put the lines one after the other in arena
+// blocks of ARENA_SIZE bytes instead of allocating each one. These
+// lines have the ARENA flag and are not freed when removed or replaced,
+// the blocks are freed by clear().
+
+#define ARENA_SIZE 65536
+
+struct Fl_Browser_Arena {
+  Fl_Browser_Arena* next;
+  size_t used, size;	// bytes used and allocated after this header
+};
+
+////////////////////////////////////////////////////////////////
+// Format codes:
+
+// The format codes at the start of each column of a line are parsed
+// once, by line_format(), into a Fl_Browser_Format that item_height(),
+// item_width() and item_draw() use. A line without format codes or
+// column_char() only gets the PARSED flag, and a line with columns but
+// no format codes only gets the offsets where its columns end. The line
+// is split at every column_char(), so that changing column_widths() does
+// not need parsing again, but changing format_char() or column_char() does.
+//
+// The formats are allocated one after the other in arena blocks that grow
+// up to FORMAT_ARENA_SIZE bytes. A format that is freed stays in its block
+// until more than half of the bytes are unused, then all the lines are
+// parsed again as needed into the first block.
+
+#define FORMAT_ARENA_SIZE 65536
+
+#define COLUMN_FONT 1		// font is set
+#define COLUMN_COLOR 2		// color is set
+#define COLUMN_BGCOLOR 4	// draw the background in bgcolor
+#define COLUMN_LINE 8		// draw an engraved line
+#define COLUMN_UNDERLINE 16	// underline the column
+#define COLUMN_UCOLOR 32	// underline in ucolor, else in textcolor()
+
+struct Fl_Browser_Column {
+  int text;		// offset of the text after the format codes
+  uchar flags;		// COLUMN_* above
+  uchar bits;		// FL_BOLD and FL_ITALIC added to the font
+  uchar align;		// FL_ALIGN_LEFT, FL_ALIGN_CENTER or FL_ALIGN_RIGHT
+  int size;		// text size, 0 for textsize()
+  Fl_Font font;
+  Fl_Color color, bgcolor, ucolor;
+};
+
+struct Fl_Browser_Format {
+  int columns;
+  Fl_Browser_Column* column;	// format codes of each column, NULL if none
+  int end[1];			// offset of the column_char() or end of the line
+				// of each column, start of allocated array
+};
+
+// Returns the bytes used by a format, with or without the format codes:
+static size_t format_size(int columns, int codes) {
+  size_t size = (sizeof(Fl_Browser_Format) + (columns - 1) * sizeof(int) + 7) & ~(size_t)7;
+  if (codes) size += columns * sizeof(Fl_Browser_Column);
+  return size;
+}
+
+// Returns the format codes of column c, NULL if it uses the defaults:
+static const Fl_Browser_Column* format_column(const Fl_Browser_Format* f, int c) {
+  return f && f->column ? f->column + c : 0;
+}
+
+// Returns the offset of the text of column c, after its format codes:
+static int column_text(const Fl_Browser_Format* f, int c) {
+  if (!f) return 0;
+  if (f->column) return f->column[c].text;
+  return c ? f->end[c - 1] + 1 : 0;
+}
+
+// Allocates size bytes for a format, see "Format codes" above:
+void* Fl_Browser::format_alloc(size_t size) {
+  if (format_waste_ > format_used_ / 2 &&
+      format_waste_ > lines * sizeof(FL_BLINE*)) free_formats(); // pays for the walk
+  Fl_Browser_Arena* a = format_arena_;
+  if (!a || a->used + size > a->size) {
+    size_t n = a ? 2 * a->size : 1024;
+    if (n > FORMAT_ARENA_SIZE) n = FORMAT_ARENA_SIZE;
+    if (n < size) n = size;
+    a = (Fl_Browser_Arena*)malloc(sizeof(Fl_Browser_Arena) + n);
+    a->next = format_arena_;
+    a->used = 0;
+    a->size = n;
+    format_arena_ = a;
+  }
+  void* f = (char*)(a + 1) + a->used;
+  a->used += size;
+  format_used_ += size;
+  return f;
+}
+
+// Frees the format of a line, so that it is parsed again when needed:
+void Fl_Browser::free_format(FL_BLINE* l) {
+  Fl_Browser_Format* f = l->format;
+  if (f) format_waste_ += format_size(f->columns, f->column != 0);
+  l->format = 0;
+  l->flags &= ~PARSED;
+}
+
+// Frees the formats of all the lines, keeping the newest arena block:
+void Fl_Browser::free_formats() {
+  for (FL_BLINE* t = first; t; t = t->next) {
+    t->format = 0;
+    t->flags &= ~PARSED;
+  }
+  if (format_arena_) {
+    while (format_arena_->next) {
+      Fl_Browser_Arena* a = format_arena_->next;
+      format_arena_->next = a->next;
+      free(a);
+    }
+    format_arena_->used = 0;
+  }
+  format_used_ = format_waste_ = 0;
+}
+
+// parses the format codes of the column from s to e, where *e is 0
+static void parse_column(const char* txt, const char* s, const char* e,
+                         char fc, Fl_Browser_Column* c) {
+  memset(c, 0, sizeof(*c));
+  c->align = FL_ALIGN_LEFT;
+  char* str = (char*)s;
+  if (fc) while (str < e && *str == fc && ++str < e && *str != fc) {
+    switch (*str++) {
+    case 'l': case 'L': c->size = 24; break;
+    case 'm': case 'M': c->size = 18; break;
+    case 's': c->size = 11; break;
+    case 'b': c->bits |= FL_BOLD; break;
+    case 'i': c->bits |= FL_ITALIC; break;
+    case 'f': case 't': c->font = FL_COURIER; c->bits = 0; c->flags |= COLUMN_FONT; break;
+    case 'c': c->align = FL_ALIGN_CENTER; break;
+    case 'r': c->align = FL_ALIGN_RIGHT; break;
+    case 'B':
+      c->bgcolor = (Fl_Color)strtoul(str, &str, 10);
+      c->flags |= COLUMN_BGCOLOR;
+      break;
+    case 'C':
+      c->color = (Fl_Color)strtoul(str, &str, 10);
+      c->flags |= COLUMN_COLOR;
+      break;
+    case 'F':
+      c->font = (Fl_Font)strtol(str, &str, 10);
+      c->bits = 0;
+      c->flags |= COLUMN_FONT;
+      break;
+    case 'N':
+      c->color = FL_INACTIVE_COLOR;
+      c->flags |= COLUMN_COLOR;
+      break;
+    case 'S':
+      c->size = strtol(str, &str, 10);
+      break;
+    case '-':
+      c->flags |= COLUMN_LINE;
+      break;
+    case 'u':
+    case '_':
+      c->flags |= COLUMN_UNDERLINE;
+      if (c->flags & COLUMN_COLOR) {c->ucolor = c->color; c->flags |= COLUMN_UCOLOR;}
+      break;
+    case '.':
+      goto BREAK;
+    case '@':
+      str--; goto BREAK;
+    }
+  }
+BREAK:
+  if (str > e) str = (char*)e;
+  c->text = int(str - txt);
+}
+
+// Returns the parsed format codes of a line, NULL if it has none:
+Fl_Browser_Format* Fl_Browser::line_format(FL_BLINE* l) const {
+  Fl_Browser* b = (Fl_Browser*)this;
+  if (parsed_format_char_ != format_char_ || parsed_column_char_ != column_char_) {
+    b->free_formats();
+    b->parsed_format_char_ = format_char_;
+    b->parsed_column_char_ = column_char_;
+  }
+  if (l->flags & PARSED) return l->format;
+  const char* txt = l->txt;
+  int columns = 1;
+  int codes = format_char_ && txt[0] == format_char_;
+  if (column_char_) for (const char* p = txt; (p = strchr(p, column_char_)); ) {
+    columns++;
+    if (format_char_ && *++p == format_char_) codes = 1;
+  }
+  if (columns == 1 && !codes) {l->flags |= PARSED; return 0;}
+  Fl_Browser_Format* f = (Fl_Browser_Format*)b->format_alloc(format_size(columns, codes));
+  f->columns = columns;
+  f->column = codes ? (Fl_Browser_Column*)((char*)f + format_size(columns, 0)) : 0;
+  if (codes) {
+    // parse a copy with each column ended by a 0, so that numbers stop there:
+    int length = (int) strlen(txt);
+    char buf[256];
+    char* copy = length < (int)sizeof(buf) ? buf : (char*)malloc(length + 1);
+    memcpy(copy, txt, length + 1);
+    char* s = copy;
+    for (int i = 0; i < columns; i++) {
+      char* e = column_char_ ? strchr(s, column_char_) : 0;
+      if (e) *e = 0; else e = s + strlen(s);
+      parse_column(copy, s, e, format_char_, f->column + i);
+      f->end[i] = int(e - copy);
+      s = e + 1;
+    }
+    if (copy != buf) free(copy);
+  } else {
+    const char* s = txt;
+    for (int i = 0; i < columns - 1; i++) {
+      s = strchr(s, column_char_);
+      f->end[i] = int(s++ - txt);
+    }
+    f->end[columns - 1] = int(strlen(s) + (s - txt));
+  }
+  l->format = f;
+  l->flags |= PARSED;
+  return f;
+}
+
+// Sets the font of a column, c is NULL for a line without format codes:
+static void column_font(const Fl_Browser* b, const Fl_Browser_Column* c) {
+  if (!c) {fl_font(b->textfont(), b->textsize()); return;}
+  fl_font((Fl_Font)(((c->flags & COLUMN_FONT) ? c->font : b->textfont()) | c->bits),
+          c->size ? c->size : b->textsize());
+}
+
+////////////////////////////////////////////////////////////////
+
 /**
   Returns the very first item in the list.
   Example of use:
@@ -131,13 +649,10 @@ const char *Fl_Browser::item_text(void *item) const {
 /**
   Returns the item for specified \p line.
 
-  Note: This call is slow. It's fine for e.g. responding to user
-  clicks, but slow if called often, such as in a tight sorting loop.
-  Finding an item 'by line' involves a linear lookup on the internal
-  linked list. The performance hit can be significant if the browser's
-  contents is large, and the method is called often (e.g. during a sort).
+  Note: Finding an item 'by line' uses an index of the lines, built
+  the first time a line is looked up, and takes O(log n) time.
   If you're writing a subclass, use the protected methods item_first(),
-  item_next(), etc. to access the internal linked list more efficiently.
+  item_next(), etc. to walk the internal linked list more efficiently.
 
   \param[in] line The line number of the item to return. (1 based)
   \retval item that was found.
@@ -145,20 +660,11 @@ const char *Fl_Browser::item_text(void *item) const {
   \see item_at(), find_line(), lineno()
 */
 FL_BLINE* Fl_Browser::find_line(int line) const {
-  int n; FL_BLINE* l;
-  if (line == cacheline) return cache;
-  if (cacheline && line > (cacheline/2) && line < ((cacheline+lines)/2)) {
-    n = cacheline; l = cache;
-  } else if (line <= (lines/2)) {
-    n = 1; l = first;
-  } else {
-    n = lines; l = last;
-  }
-  for (; n < line && l; n++) l = l->next;
-  for (; n > line && l; n--) l = l->prev;
-  ((Fl_Browser*)this)->cacheline = line;
-  ((Fl_Browser*)this)->cache = l;
-  return l;
+  if (line < 1 || line > lines) return 0;
+  if (line == 1) return first;
+  if (line == lines) return last;
+  index_lines(0);
+  return index_->find(line);
 }
 
 /**
@@ -171,28 +677,51 @@ FL_BLINE* Fl_Browser::find_line(int line) const {
 int Fl_Browser::lineno(void *item) const {
   FL_BLINE* l = (FL_BLINE*)item;
   if (!l) return 0;
-  if (l == cache) return cacheline;
   if (l == first) return 1;
   if (l == last) return lines;
-  if (!cache) {
-    ((Fl_Browser*)this)->cache = first;
-    ((Fl_Browser*)this)->cacheline = 1;
-  }
-  // assume it is near cache, search both directions:
-  FL_BLINE* b = cache->prev;
-  int bnum = cacheline-1;
-  FL_BLINE* f = cache->next;
-  int fnum = cacheline+1;
-  int n = 0;
-  for (;;) {
-    if (b == l) {n = bnum; break;}
-    if (f == l) {n = fnum; break;}
-    if (b) {b = b->prev; bnum--;}
-    if (f) {f = f->next; fnum++;}
+  index_lines(0);
+  return index_->lineno(l);
+}
+
+// Builds the line index if needed, with the line heights if heights is set:
+void Fl_Browser::index_lines(int heights) const {
+  if (!index_->built()) index_->build(first);
+  if (heights && !index_->heights()) {
+    int *h = (int*)malloc((lines + 1) * sizeof(int)), n = 0;
+    for (FL_BLINE* l = first; l; l = l->next) h[n++] = item_height(l);
+    index_->heights(h);
+    free(h);
   }
-  ((Fl_Browser*)this)->cache = l;
-  ((Fl_Browser*)this)->cacheline = n;
-  return n;
+}
+
+/**
+  Returns the item at the vertical scrolling position \p pos, and sets
+  \p item_pos to the position of its top, using the index of the lines.
+  Hidden lines are skipped. If \p pos is past the end, the last item
+  is returned.
+  \param[in] pos The position, in pixels from the top of the first line.
+  \param[out] item_pos The position of the top of the returned item.
+  \returns The item, or NULL if the browser is empty.
+  \see item_position()
+*/
+void* Fl_Browser::item_at_position(int pos, int &item_pos) const {
+  if (!lines) return 0;
+  index_lines(1);
+  return index_->find_position(pos, item_pos);
+}
+
+/**
+  Returns the vertical scrolling position of the top of \p item,
+  using the index of the lines.
+  \param[in] item The item to be found.
+  \returns The position, in pixels from the top of the first line.
+  \see item_at_position()
+*/
+int Fl_Browser::item_position(void *item) const {
+  if (!item) return -1;
+  if (item == first) return 0;
+  index_lines(1);
+  return index_->position((FL_BLINE*)item);
 }
 
 /**
@@ -207,8 +736,7 @@ FL_BLINE* Fl_Browser::_remove(int line) {
   FL_BLINE* ttt = find_line(line);
   deleting(ttt);
 
-  cacheline = line-1;
-  cache = ttt->prev;
+  if (index_->built()) index_->remove(ttt);
   lines--;
   full_height_ -= item_height(ttt);
   if (ttt->prev) ttt->prev->next = ttt->next;
@@ -228,7 +756,9 @@ FL_BLINE* Fl_Browser::_remove(int line) {
 */
 void Fl_Browser::remove(int line) {
   if (line < 1 || line > lines) return;
-  free(_remove(line));
+  FL_BLINE* t = _remove(line);
+  free_format(t);
+  if (!(t->flags & ARENA)) free(t);
 }
 
 /**
@@ -263,10 +793,10 @@ void Fl_Browser::insert(int line, FL_BLINE* item) {
     item->prev->next = item;
     n->prev = item;
   }
-  cacheline = line;
-  cache = item;
+  int h = item_height(item);
+  if (index_->built()) index_->insert(item, item->next, h);
   lines++;
-  full_height_ += item_height(item);
+  full_height_ += h;
   redraw_line(item);
 }
 
@@ -292,6 +822,7 @@ void Fl_Browser::insert(int line, const char* newtext, void* d) {
   strcpy(t->txt, newtext);
   t->data = d;
   t->icon = 0;
+  t->format = 0;
   insert(line, t);
 }
 
@@ -322,22 +853,28 @@ void Fl_Browser::text(int line, const char* newtext) {
   FL_BLINE* t = find_line(line);
   if (!newtext) newtext = "";		// STR #3269
   int l = (int) strlen(newtext);
+  int old_h = item_height(t);
   if (l > t->length) {
     FL_BLINE* n = (FL_BLINE*)malloc(sizeof(FL_BLINE)+l);
     replacing(t, n);
-    cache = n;
+    if (index_->built()) index_->replace(t, n);
     n->data = t->data;
     n->icon = t->icon;
     n->length = (short)l;
-    n->flags = t->flags;
+    n->flags = t->flags & ~ARENA;
+    n->format = t->format;
     n->prev = t->prev;
     if (n->prev) n->prev->next = n; else first = n;
     n->next = t->next;
     if (n->next) n->next->prev = n; else last = n;
-    free(t);
+    if (!(t->flags & ARENA)) free(t);
     t = n;
   }
   strcpy(t->txt, newtext);
+  free_format(t);
+  int dh = item_height(t) - old_h;	// format codes may change the height
+  full_height_ += dh;
+  if (index_->built()) index_->resized(t, dh);
   redraw_line(t);
 }
 
@@ -372,39 +909,18 @@ int Fl_Browser::item_height(void *item) const {
     int hh = fl_height();
     if (hh > hmax) hmax = hh;
   } else {
+    const Fl_Browser_Format* f = line_format(l);
     const int* i = column_widths();
     // do each column separately as they may all set different fonts:
-    for (char* str = l->txt; str && *str; str++) {
-      Fl_Font font = textfont(); // default font
-      int tsize = textsize();    // default size
-      if ( format_char() ) {     // can be NULL
-	while (*str==format_char()) {
-	  str++;
-	  switch (*str++) {
-	  case 'l': case 'L': tsize = 24; break;
-	  case 'm': case 'M': tsize = 18; break;
-	  case 's': tsize = 11; break;
-	  case 'b': font = (Fl_Font)(font|FL_BOLD); break;
-	  case 'i': font = (Fl_Font)(font|FL_ITALIC); break;
-	  case 'f': case 't': font = FL_COURIER; break;
-	  case 'B':
-	  case 'C': while (isdigit(*str & 255)) str++; break; // skip a color number
-	  case 'F': font = (Fl_Font)strtol(str,&str,10); break;
-	  case 'S': tsize = strtol(str,&str,10); break;
-	  case 0: case '@': str--;
-	  case '.': goto END_FORMAT;
-	  }
-	}
-      }
-      END_FORMAT:
-      char* ptr = str;
-      if (ptr && *i++) str = strchr(str, column_char());
-      else str = NULL;
-      if((!str && *ptr) || (str && ptr < str)) {
-	fl_font(font, tsize); int hh = fl_height();
+    for (int c = 0; ; c++) {
+      const Fl_Browser_Column* col = format_column(f, c);
+      int last = !f || c == f->columns - 1 || !i[c];
+      const char* str = l->txt + column_text(f, c);
+      if (last ? *str != 0 : l->txt + f->end[c] > str) {
+	column_font(this, col); int hh = fl_height();
 	if (hh > hmax) hmax = hh;
       }
-      if (!str || !*str) break;
+      if (last) break;
     }
   }
 
@@ -424,56 +940,22 @@ int Fl_Browser::item_height(void *item) const {
 */
 int Fl_Browser::item_width(void *item) const {
   FL_BLINE* l=(FL_BLINE*)item;
-  char* str = l->txt;
+  const Fl_Browser_Format* f = line_format(l);
   const int* i = column_widths();
   int ww = 0;
+  int c = 0;
 
-  while (*i) { // add up all tab-separated fields
-    char* e;
-    e = strchr(str, column_char());
-    if (!e) break; // last one occupied by text
-    str = e+1;
-    ww += *i++;
-  }
-
-  // OK, we gotta parse the string and find the string width...
-  int tsize = textsize();
-  Fl_Font font = textfont();
-  int done = 0;
-
-  if ( format_char() ) {	// can be NULL
-    while (*str == format_char_ && str[1] && str[1] != format_char_) {
-      str ++;
-      switch (*str++) {
-      case 'l': case 'L': tsize = 24; break;
-      case 'm': case 'M': tsize = 18; break;
-      case 's': tsize = 11; break;
-      case 'b': font = (Fl_Font)(font|FL_BOLD); break;
-      case 'i': font = (Fl_Font)(font|FL_ITALIC); break;
-      case 'f': case 't': font = FL_COURIER; break;
-      case 'B':
-      case 'C': while (isdigit(*str & 255)) str++; break; // skip a color number
-      case 'F': font = (Fl_Font)strtol(str, &str, 10); break;
-      case 'S': tsize = strtol(str, &str, 10); break;
-      case '.':
-	done = 1;
-	break;
-      case '@':
-	str--;
-	done = 1;
-      }
-
-    if (done)
-      break;
-    }
-    if (*str == format_char_ && str[1])
-      str ++;
+  if (f) while (c < f->columns - 1 && i[c]) { // add up all tab-separated fields
+    ww += i[c++];
   }
 
+  // the last one is occupied by the text:
+  const Fl_Browser_Column* col = format_column(f, c);
+
   if (ww==0 && l->icon) ww = l->icon->w();
 
-  fl_font(font, tsize);
-  return ww + int(fl_width(str)) + 6;
+  column_font(this, col);
+  return ww + int(fl_width(l->txt + column_text(f, c))) + 6;
 }
 
 /**
@@ -508,16 +990,17 @@ int Fl_Browser::incr_height() const {
 */
 void Fl_Browser::item_draw(void* item, int X, int Y, int W, int H) const {
   FL_BLINE* l = (FL_BLINE*)item;
-  char* str = l->txt;
+  const Fl_Browser_Format* f = line_format(l);
   const int* i = column_widths();
 
   bool first = true;	// for icon
-  while (W > 6) {	// do each tab-separated field
+  for (int c = 0; W > 6; c++) {	// do each tab-separated field
+    const Fl_Browser_Column* col = format_column(f, c);
     int w1 = W;	// width for this field
     char* e = 0; // pointer to end of field or null if none
-    if (*i) { // find end of field and temporarily replace with 0
-      e = strchr(str, column_char());
-      if (e) {*e = 0; w1 = *i++;}
+    if (f && c < f->columns - 1 && i[c]) { // temporarily replace end of field with 0
+      e = l->txt + f->end[c];
+      *e = 0; w1 = i[c];
     }
     // Icon drawing code
     if (first) {
@@ -528,73 +1011,37 @@ void Fl_Browser::item_draw(void* item, int X, int Y, int W, int H) const {
 	X += iconw; W -= iconw; w1 -= iconw;
       }
     }
-    int tsize = textsize();
-    Fl_Font font = textfont();
     Fl_Color lcol = textcolor();
     Fl_Align talign = FL_ALIGN_LEFT;
-    // check for all the @-lines recognized by XForms:
-    //#if defined(__GNUC__)
-    //#warning FIXME This maybe needs to be more UTF8 aware now...?
-    //#endif /*__GNUC__*/
-    if ( format_char() ) {	// can be NULL
-      while (*str == format_char() && *++str && *str != format_char()) {
-	switch (*str++) {
-	case 'l': case 'L': tsize = 24; break;
-	case 'm': case 'M': tsize = 18; break;
-	case 's': tsize = 11; break;
-	case 'b': font = (Fl_Font)(font|FL_BOLD); break;
-	case 'i': font = (Fl_Font)(font|FL_ITALIC); break;
-	case 'f': case 't': font = FL_COURIER; break;
-	case 'c': talign = FL_ALIGN_CENTER; break;
-	case 'r': talign = FL_ALIGN_RIGHT; break;
-	case 'B': 
-	  if (!(l->flags & SELECTED)) {
-	    fl_color((Fl_Color)strtoul(str, &str, 10));
-	    fl_rectf(X, Y, w1, H);
-	  } else while (isdigit(*str & 255)) str++; // skip digits
-	  break;
-	case 'C':
-	  lcol = (Fl_Color)strtoul(str, &str, 10);
-	  break;
-	case 'F':
-	  font = (Fl_Font)strtol(str, &str, 10);
-	  break;
-	case 'N':
-	  lcol = FL_INACTIVE_COLOR;
-	  break;
-	case 'S':
-	  tsize = strtol(str, &str, 10);
-	  break;
-	case '-':
-	  fl_color(FL_DARK3);
-	  fl_line(X+3, Y+H/2, X+w1-3, Y+H/2);
-	  fl_color(FL_LIGHT3);
-	  fl_line(X+3, Y+H/2+1, X+w1-3, Y+H/2+1);
-	  break;
-	case 'u':
-	case '_':
-	  fl_color(lcol);
-	  fl_line(X+3, Y+H-1, X+w1-3, Y+H-1);
-	  break;
-	case '.':
-	  goto BREAK;
-	case '@':
-	  str--; goto BREAK;
-	}
+    if (col) { // draw what the @-codes ask for
+      if (col->flags & COLUMN_COLOR) lcol = col->color;
+      talign = col->align;
+      if ((col->flags & COLUMN_BGCOLOR) && !(l->flags & SELECTED)) {
+	fl_color(col->bgcolor);
+	fl_rectf(X, Y, w1, H);
+      }
+      if (col->flags & COLUMN_LINE) {
+	fl_color(FL_DARK3);
+	fl_line(X+3, Y+H/2, X+w1-3, Y+H/2);
+	fl_color(FL_LIGHT3);
+	fl_line(X+3, Y+H/2+1, X+w1-3, Y+H/2+1);
+      }
+      if (col->flags & COLUMN_UNDERLINE) {
+	fl_color((col->flags & COLUMN_UCOLOR) ? col->ucolor : textcolor());
+	fl_line(X+3, Y+H-1, X+w1-3, Y+H-1);
       }
     }
-  BREAK:
-    fl_font(font, tsize);
+    column_font(this, col);
     if (l->flags & SELECTED)
       lcol = fl_contrast(lcol, selection_color());
     if (!active_r()) lcol = fl_inactive(lcol);
     fl_color(lcol);
-    fl_draw(str, X+3, Y, w1-6, H, e ? Fl_Align(talign|FL_ALIGN_CLIP) : talign, 0, 0);
+    fl_draw(l->txt + column_text(f, c), X+3, Y, w1-6, H,
+            e ? Fl_Align(talign|FL_ALIGN_CLIP) : talign, 0, 0);
     if (!e) break; // no more fields...
     *e = column_char(); // put the separator back
     X += w1;
     W -= w1;
-    str = e+1;
   }
 }
 
@@ -610,10 +1057,21 @@ Fl_Browser::Fl_Browser(int X, int Y, int W, int H, const char *L)
   column_widths_ = no_columns;
   lines = 0;
   full_height_ = 0;
-  cacheline = 0;
-  format_char_ = '@';
-  column_char_ = '\t';
-  first = last = cache = 0;
+  format_char_ = parsed_format_char_ = '@';
+  column_char_ = parsed_column_char_ = '\t';
+  first = last = 0;
+  index_ = new Fl_Browser_Index;
+  arena_ = 0;
+  format_arena_ = 0;
+  format_used_ = format_waste_ = 0;
+}
+
+/**
+  The destructor deletes all list items and destroys the browser.
+*/
+Fl_Browser::~Fl_Browser() {
+  clear();
+  delete index_;
 }
 
 /**
@@ -625,11 +1083,13 @@ Fl_Browser::Fl_Browser(int X, int Y, int W, int H, const char *L)
 void Fl_Browser::lineposition(int line, Fl_Line_Position pos) {
   if (line<1) line = 1;
   if (line>lines) line = lines;
-  int p = 0;
-
-  FL_BLINE* l;
-  for (l=first; l && line>1; l = l->next) {
-    line--; p += item_height(l);
+  FL_BLINE* l = find_line(line);
+  int p = item_position(l);
+  if (p < 0) { // the subclass does not know the positions
+    p = 0;
+    for (l=first; l && line>1; l = l->next) {
+      line--; p += item_height(l);
+    }
   }
   if (l && (pos == BOTTOM)) p += item_height (l);
 
@@ -676,6 +1136,7 @@ void Fl_Browser::textsize(Fl_Fontsize newSize) {
     return; // avoid recalculation
   Fl_Browser_::textsize(newSize);
   new_list();
+  index_->drop_heights();
   full_height_ = 0;
   if (lines == 0) return;
   for (FL_BLINE* itm=(FL_BLINE *)item_first(); itm; itm=(FL_BLINE *)item_next(itm)) {
@@ -690,13 +1151,25 @@ void Fl_Browser::textsize(Fl_Fontsize newSize) {
 void Fl_Browser::clear() {
   for (FL_BLINE* l = first; l;) {
     FL_BLINE* n = l->next;
-    free(l);
+    if (!(l->flags & ARENA)) free(l);
     l = n;
   }
+  while (arena_) {
+    Fl_Browser_Arena* a = arena_->next;
+    free(arena_);
+    arena_ = a;
+  }
+  while (format_arena_) {
+    Fl_Browser_Arena* a = format_arena_->next;
+    free(format_arena_);
+    format_arena_ = a;
+  }
+  format_used_ = format_waste_ = 0;
   full_height_ = 0;
   first = 0;
   last = 0;
   lines = 0;
+  index_->clear();
   new_list();
 }
 
@@ -717,6 +1190,59 @@ void Fl_Browser::add(const char* newtext, void* d) {
   //Fl_Browser_::display(last);
 }
 
+// Adds a line at the end, stored in the arena:
+void Fl_Browser::append(const char *text, int length) {
+  size_t size = (sizeof(FL_BLINE) + length + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+  Fl_Browser_Arena* a = arena_;
+  if (!a || a->used + size > a->size) {
+    size_t n = size > ARENA_SIZE ? size : ARENA_SIZE;
+    a = (Fl_Browser_Arena*)malloc(sizeof(Fl_Browser_Arena) + n);
+    a->next = arena_;
+    a->used = 0;
+    a->size = n;
+    arena_ = a;
+  }
+  FL_BLINE* t = (FL_BLINE*)((char*)(a + 1) + a->used);
+  a->used += size;
+  t->length = (short)length;
+  t->flags = ARENA;
+  memcpy(t->txt, text, length);
+  t->txt[length] = 0;
+  t->data = 0;
+  t->icon = 0;
+  t->format = 0;
+  t->prev = last;
+  t->next = 0;
+  if (last) last->next = t; else first = t;
+  last = t;
+  lines++;
+  int h = item_height(t);
+  full_height_ += h;
+  if (index_->built()) index_->insert(t, 0, h);
+}
+
+/**
+  Adds \p n lines to the end of the browser, copying the text of line i
+  from \p text[i], which can be NULL to make a blank line.
+  The data() of each line is set to NULL.
+
+  The lines are stored one after the other in large blocks of memory,
+  instead of being allocated one by one as with add(), which is much
+  faster when adding many lines. The memory of these lines is only
+  released by clear(), even if they are removed before.
+
+  \param[in] text The label texts of the lines.
+  \param[in] n The number of lines.
+  \see add(), load(), clear()
+*/
+void Fl_Browser::add_lines(const char* const* text, int n) {
+  for (int i = 0; i < n; i++) {
+    const char* t = text[i] ? text[i] : "";
+    append(t, (int) strlen(t));
+  }
+  redraw_lines();
+}
+
 /**
   Returns the label text for the specified \p line.
   Return value can be NULL if \p line is out of range or unset.
@@ -778,7 +1304,9 @@ void Fl_Browser::show(int line) {
   FL_BLINE* t = find_line(line);
   if (t->flags & NOTDISPLAYED) {
     t->flags &= ~NOTDISPLAYED;
-    full_height_ += item_height(t);
+    int h = item_height(t);
+    full_height_ += h;
+    if (index_->built()) index_->resized(t, h);
     if (Fl_Browser_::displayed(t)) redraw();
   }
 }
@@ -795,7 +1323,9 @@ void Fl_Browser::show(int line) {
 void Fl_Browser::hide(int line) {
   FL_BLINE* t = find_line(line);
   if (!(t->flags & NOTDISPLAYED)) {
-    full_height_ -= item_height(t);
+    int h = item_height(t);
+    full_height_ -= h;
+    if (index_->built()) index_->resized(t, -h);
     t->flags |= NOTDISPLAYED;
     if (Fl_Browser_::displayed(t)) redraw();
   }
@@ -872,9 +1402,7 @@ void Fl_Browser::swap(FL_BLINE *a, FL_BLINE *b) {
      if ( bprev ) bprev->next = a; else first = a;
      a->next = bnext;
   }
-  // Disable cache -- we played around with positions
-  cacheline = 0;
-  cache = 0;
+  if (index_->built()) index_->swap(a, b);
 }
 
 /**
@@ -912,6 +1440,7 @@ void Fl_Browser::icon(int line, Fl_Image* icon) {
   if (th > new_h) new_h = th;
   int dh = new_h - old_h;
   full_height_ += dh;				// do this *always*
+  if (index_->built()) index_->resized(bl, dh);
 
   bl->icon = icon;				// set new icon
   if (dh>0) {
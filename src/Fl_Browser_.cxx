@@ -23,6 +23,9 @@
 #include <FL/Fl_Widget.H>
 #include <FL/Fl_Browser_.H>
 #include <FL/fl_draw.H>
+#include "flstring.h"
+#include <stdlib.h>
+#include <ctype.h>
 
 
 // This is the base class for browsers.  To be useful it must be
@@ -136,8 +139,11 @@ void Fl_Browser_::update_top() {
     void* l;
     int ly;
     int yy = position_;
-    // start from either head or current position, whichever is closer:
-    if (!top_ || yy <= (real_position_/2)) {
+    // start from the item at that position if the subclass can find it,
+    // else from either head or current position, whichever is closer:
+    if ((l = item_at_position(yy, ly)) != 0) {
+      // found
+    } else if (!top_ || yy <= (real_position_/2)) {
       l = item_first();
       ly = 0;
     } else {
@@ -260,6 +266,25 @@ void Fl_Browser_::display(void* item) {
   void* lp = item_prev(l);
   if (lp == item) {position(real_position_+Y-item_quick_height(lp)); return;}
 
+  // if the subclass knows where the item is, there is no need to search:
+  int ip = item_position(item);
+  if (ip >= 0) {
+    h1 = item_quick_height(item);
+    Y = ip - real_position_;
+    if (Y >= -offset_) { // at or below the top item
+      if (Y <= H) { // it is visible or right at bottom
+	Y = Y+h1-H; // find where bottom edge is
+	if (Y > 0) position(real_position_+Y); // scroll down a bit
+      } else {
+	position(real_position_+Y-(H-h1)/2); // center it
+      }
+    } else {
+      if ((Y + h1) >= 0) position(real_position_+Y);
+      else position(real_position_+Y-(H-h1)/2);
+    }
+    return;
+  }
+
 #ifdef DISPLAY_SEARCH_BOTH_WAYS_AT_ONCE
   // search for item.  We search both up and down the list at the same time,
   // this evens up the execution time for the two cases - the old way was
@@ -981,51 +1006,115 @@ Fl_Browser_::Fl_Browser_(int X, int Y, int W, int H, const char* L)
   end();
 }
 
+static int sort_strcmp(const char *a, const char *b) {
+  return strcmp(a, b);
+}
+
+static int sort_strcasecmp(const char *a, const char *b) {
+  for (;; a++, b++) {
+    int c = tolower(*a & 255), d = tolower(*b & 255);
+    if (c != d || !c) return c - d;
+  }
+}
+
+static int sort_numeric(const char *a, const char *b) {
+  return fl_numeric_strcmp(a, b, 1);
+}
+
+static int sort_casenumeric(const char *a, const char *b) {
+  return fl_numeric_strcmp(a, b, 0);
+}
+
 /**
   Sort the items in the browser based on \p flags.
   item_swap(void*, void*) and item_text(void*) must be implemented for this call.
   \param[in] flags FL_SORT_ASCENDING -- sort in ascending order\n
                    FL_SORT_DESCENDING -- sort in descending order\n
-		   Values other than the above will cause undefined behavior\n
-		   Other flags may appear in the future.
-  \todo Add a flag to ignore case
+                   FL_SORT_CASEINSENSITIVE -- ignore the case of letters\n
+                   FL_SORT_NUMERIC -- compare the numbers in the text by value,
+                   so that "item 9" comes before "item 10"\n
+                   Other flags may appear in the future.
+  \see sort(Fl_Browser_Sort_F*, int)
 */
 void Fl_Browser_::sort(int flags) {
-  //
-  // Simple bubble sort - pure lazyness on my side.
-  //
-  int i, j, n = -1, desc = ((flags&FL_SORT_DESCENDING)==FL_SORT_DESCENDING);
-  void *a =item_first(), *b, *c;
-  if (!a) return;
-  while (a) {
-    a = item_next(a);
-    n++;
+  Fl_Browser_Sort_F *compare;
+  if (flags & FL_SORT_NUMERIC)
+    compare = (flags & FL_SORT_CASEINSENSITIVE) ? sort_casenumeric : sort_numeric;
+  else
+    compare = (flags & FL_SORT_CASEINSENSITIVE) ? sort_strcasecmp : sort_strcmp;
+  sort(compare, flags);
+}
+
+/**
+  Sort the items in the browser, comparing their text with \p compare.
+  The sort is stable: items that compare equal keep their order.
+  item_text(void*) is called once per item, and item_swap(void*, void*)
+  at most once per item, so sorting n items takes O(n log n) time.
+  \param[in] compare returns a value less than, equal to or greater than
+                     zero if the first text is before, equal to or after the
+                     second one, as strcmp() does
+  \param[in] flags FL_SORT_ASCENDING or FL_SORT_DESCENDING, the other
+                   flags of sort(int) are ignored
+*/
+void Fl_Browser_::sort(Fl_Browser_Sort_F *compare, int flags) {
+  int desc = ((flags&FL_SORT_DESCENDING)==FL_SORT_DESCENDING);
+  int i, n = 0;
+  void *a;
+  for (a = item_first(); a; a = item_next(a)) n++;
+  if (n < 2) return;
+
+  // get the items and their text once:
+  void **item = (void**)malloc(n * sizeof(void*));
+  const char **text = (const char**)malloc(n * sizeof(const char*));
+  for (i = 0, a = item_first(); a; a = item_next(a), i++) {
+    item[i] = a;
+    text[i] = item_text(a);
+    if (!text[i]) text[i] = "";
   }
-  for (i=n; i>0; i--) {
-    char swapped = 0;
-    a = item_first();
-    b = item_next(a);
-    for (j=0; j<i; j++) {
-      const char *ta = item_text(a);
-      const char *tb = item_text(b);
-      c = item_next(b);
-      if (desc) {
-        if (strcmp(ta, tb)<0) {
-          item_swap(a, b);
-          swapped = 1;
-        }
-      } else {
-        if (strcmp(ta, tb)>0) {
-          item_swap(a, b);
-          swapped = 1;
-        }
+
+  // merge sort the item numbers, from runs of 1 up:
+  int *order = (int*)malloc(n * sizeof(int));
+  int *tmp = (int*)malloc(n * sizeof(int));
+  for (i = 0; i < n; i++) order[i] = i;
+  for (int run = 1; run < n; run *= 2) {
+    for (int lo = 0; lo < n; lo += 2 * run) {
+      int mid = lo + run, hi = lo + 2 * run;
+      if (mid >= n) {
+        for (i = lo; i < n; i++) tmp[i] = order[i];
+        continue;
       }
-      if (!c) break;
-      b = c; a = item_prev(b);
+      if (hi > n) hi = n;
+      int l = lo, r = mid, k = lo;
+      while (l < mid && r < hi) {
+        int c = compare(text[order[l]], text[order[r]]);
+        if (desc) c = -c;
+        tmp[k++] = (c <= 0) ? order[l++] : order[r++]; // equal: left first
+      }
+      while (l < mid) tmp[k++] = order[l++];
+      while (r < hi) tmp[k++] = order[r++];
     }
-    if (!swapped)
-      break;
+    int *t = order; order = tmp; tmp = t;
   }
+
+  // move each item to its place, tmp[] giving the position of each item
+  // and at[] the item at each position:
+  int *at = (int*)malloc(n * sizeof(int));
+  for (i = 0; i < n; i++) tmp[i] = at[i] = i;
+  for (i = 0; i < n; i++) {
+    int j = order[i];   // the item that goes to position i
+    int p = tmp[j];     // where it is now
+    if (p == i) continue;
+    int o = at[i];      // the item now at position i, it goes to position p
+    item_swap(item[o], item[j]);
+    at[p] = o; tmp[o] = p;
+    at[i] = j; tmp[j] = i;
+  }
+
+  free(at);
+  free(tmp);
+  free(order);
+  free((void*)text);
+  free(item);
 }
 
 // Default versions of some of the virtual functions:
@@ -1068,6 +1157,39 @@ int Fl_Browser_::full_height() const {
   return t;
 }
 
+/**
+  This method may be provided by the subclass to return the item at the
+  vertical scrolling position \p pos without walking the list, and to set
+  \p item_pos to the position of the top of that item. If \p pos is
+  past the end of the list, the last item should be returned.
+  The positions must agree with item_quick_height() and full_height().
+  The default implementation returns NULL, and the list is walked from
+  the top() item or from the first one.
+  \param[in] pos The position, in pixels from the top of the first item.
+  \param[out] item_pos The position of the top of the returned item.
+  \returns The item, or NULL if it is not known.
+  \see item_position()
+*/
+void *Fl_Browser_::item_at_position(int pos, int &item_pos) const {
+  (void)pos; (void)item_pos;
+  return 0L;
+}
+
+/**
+  This method may be provided by the subclass to return the vertical
+  scrolling position of the top of \p item without walking the list.
+  The default implementation returns -1, and display() searches the list
+  from the top() item.
+  \param[in] item The item whose position is returned.
+  \returns The position, in pixels from the top of the first item,
+            or -1 if it is not known.
+  \see item_at_position()
+*/
+int Fl_Browser_::item_position(void *item) const {
+  (void)item;
+  return -1;
+}
+
 /**
   This method may be provided by the subclass to indicate the full width
   of the item list, in pixels. 
@@ -28,31 +28,40 @@
   was any error in opening or reading the file, in which case errno
   is set to the system error.  The data() of each line is set
   to NULL.
+
+  As with add_lines(), the lines are stored together in large blocks
+  of memory, released by clear().
   \param[in] filename The filename to load
   \returns 1 if OK, 0 on error (errno has reason)
-  \see add()
+  \see add(), add_lines()
 */
 int Fl_Browser::load(const char *filename) {
 #define MAXFL_BLINE 1024
     char newtext[MAXFL_BLINE];
+    char buf[8192];
     int c;
-    int i;
+    int i, p, n;
     clear();
     if (!filename || !(filename[0])) return 1;
     FILE *fl = fl_fopen(filename,"r");
     if (!fl) return 0;
-    i = 0;
+    i = p = n = 0;
     do {
-	c = getc(fl);
+	if (p >= n) {
+	    n = (int)fread(buf, 1, sizeof(buf), fl);
+	    p = 0;
+	}
+	c = p < n ? (buf[p++] & 255) : EOF;
 	if (c == '\n' || c <= 0 || i>=(MAXFL_BLINE-1)) {
 	    newtext[i] = 0;
-	    add(newtext);
+	    append(newtext, i);
 	    i = 0;
 	} else {
 	    newtext[i++] = c;
 	}
     } while (c >= 0);
     fclose(fl);
+    redraw_lines();
     return 1;
 }
 
@@ -45,10 +45,18 @@ Fl_Widget*const* Fl_Group::array() const {
 /**
   Searches the child array for the widget and returns the index. Returns children()
   if the widget is NULL or not found.
+
+  The children next to the one last found, added or removed are checked
+  first, so walking the children in order, or removing the widget just
+  added, does not scan the array.
 */
 int Fl_Group::find(const Fl_Widget* o) const {
   Fl_Widget*const* a = array();
+  if (hint_ < children_ && a[hint_] == o) return hint_;
+  if (hint_ + 1 < children_ && a[hint_ + 1] == o) return ++hint_;
+  if (hint_ > 0 && hint_ <= children_ && a[hint_ - 1] == o) return --hint_;
   int i; for (i=0; i < children_; i++) if (*a++ == o) break;
+  if (i < children_) hint_ = i;
   return i;
 }
 
@@ -88,6 +96,315 @@ void Fl_Group::current(Fl_Group *g) {current_ = g;}
 
 extern Fl_Widget* fl_oldfocus; // set by Fl::focus
 
+////////////////////////////////////////////////////////////////
+// Spatial index of the children:
+
+// The children are sorted into a uniform grid of cells covering their
+// bounding box. Each cell lists, in increasing order, the indexes of the
+// children that overlap it, so the children under the mouse are found
+// in the same topmost-first order as by scanning all of them.
+// Changes are applied when the index is next used: adding and removing
+// children or resizing the group rebuild the grid, and resizing a
+// child only moves it to its new cells.
+class Fl_Group_Index {
+  struct Cell {
+    int *child;
+    int n, alloc;
+  };
+  int x_, y_, cw_, ch_, cols_, rows_; // the grid
+  Cell *cells_;
+  int *range_;           // first col, first row, last col, last row of each child
+  int nrange_;
+  Fl_Widget **moved_;    // children resized since the index was updated
+  int nmoved_, amoved_;
+  int dirty_;            // the grid must be rebuilt
+
+  void range(const Fl_Widget *o, int *r) const;
+  void add(int i, const int *r);
+  void remove(int i, const int *r);
+  void rebuild(const Fl_Group *g);
+public:
+  Fl_Group_Index() : cells_(0), range_(0), nrange_(0), moved_(0), nmoved_(0), amoved_(0), dirty_(1) {
+    cols_ = rows_ = 0;
+  }
+  ~Fl_Group_Index() {
+    invalidate();
+    free(range_);
+    free(moved_);
+  }
+  void invalidate() {
+    for (int c = 0; c < cols_ * rows_; c++) free(cells_[c].child);
+    free(cells_);
+    cells_ = 0;
+    cols_ = rows_ = 0;
+    nmoved_ = 0;
+    dirty_ = 1;
+  }
+  void moved(Fl_Widget *o);
+  const int *lookup(const Fl_Group *g, int X, int Y, int &n);
+};
+
+// computes the cells covered by a child, r[0] > r[2] if none
+void Fl_Group_Index::range(const Fl_Widget *o, int *r) const {
+  if (o->w() <= 0 || o->h() <= 0) {r[0] = 1; r[2] = 0; r[1] = r[3] = 0; return;}
+  int c0 = (o->x() - x_) / cw_, c1 = (o->x() + o->w() - 1 - x_) / cw_;
+  int r0 = (o->y() - y_) / ch_, r1 = (o->y() + o->h() - 1 - y_) / ch_;
+  // children outside the grid are kept in the border cells:
+  r[0] = c0 < 0 ? 0 : c0 >= cols_ ? cols_ - 1 : c0;
+  r[2] = c1 < 0 ? 0 : c1 >= cols_ ? cols_ - 1 : c1;
+  r[1] = r0 < 0 ? 0 : r0 >= rows_ ? rows_ - 1 : r0;
+  r[3] = r1 < 0 ? 0 : r1 >= rows_ ? rows_ - 1 : r1;
+}
+
+// adds child i to the cells of range r, keeping the cells sorted
+void Fl_Group_Index::add(int i, const int *r) {
+  for (int row = r[1]; row <= r[3]; row++) {
+    for (int col = r[0]; col <= r[2]; col++) {
+      Cell &c = cells_[row * cols_ + col];
+      if (c.n >= c.alloc) {
+        c.alloc = c.alloc ? 2 * c.alloc : 4;
+        c.child = (int*)realloc(c.child, c.alloc * sizeof(int));
+      }
+      int j = c.n++;
+      for (; j > 0 && c.child[j-1] > i; j--) c.child[j] = c.child[j-1];
+      c.child[j] = i;
+    }
+  }
+}
+
+// removes child i from the cells of range r
+void Fl_Group_Index::remove(int i, const int *r) {
+  for (int row = r[1]; row <= r[3]; row++) {
+    for (int col = r[0]; col <= r[2]; col++) {
+      Cell &c = cells_[row * cols_ + col];
+      int j = 0;
+      while (j < c.n && c.child[j] != i) j++;
+      if (j == c.n) continue;
+      c.n--;
+      for (; j < c.n; j++) c.child[j] = c.child[j+1];
+    }
+  }
+}
+
+void Fl_Group_Index::rebuild(const Fl_Group *g) {
+  invalidate();
+  dirty_ = 0;
+  int n = g->children();
+  if (!n) return;
+  Fl_Widget*const* a = g->array();
+  // the grid covers the bounding box of the children:
+  int X = a[0]->x(), Y = a[0]->y(), R = X + a[0]->w(), B = Y + a[0]->h();
+  for (int i = 1; i < n; i++) {
+    const Fl_Widget *o = a[i];
+    if (o->x() < X) X = o->x();
+    if (o->y() < Y) Y = o->y();
+    if (o->x() + o->w() > R) R = o->x() + o->w();
+    if (o->y() + o->h() > B) B = o->y() + o->h();
+  }
+  // about 4 children per cell:
+  int side = 1;
+  while (side < 256 && 4 * side * side < n) side++;
+  x_ = X; y_ = Y;
+  cols_ = rows_ = side;
+  cw_ = (R - X + side - 1) / side; if (cw_ < 1) cw_ = 1;
+  ch_ = (B - Y + side - 1) / side; if (ch_ < 1) ch_ = 1;
+  cells_ = (Cell*)calloc(cols_ * rows_, sizeof(Cell));
+  if (nrange_ < n) {
+    nrange_ = n;
+    range_ = (int*)realloc(range_, 4 * n * sizeof(int));
+  }
+  for (int i = 0; i < n; i++) {
+    range(a[i], range_ + 4 * i);
+    add(i, range_ + 4 * i);
+  }
+}
+
+void Fl_Group_Index::moved(Fl_Widget *o) {
+  if (dirty_) return;
+  if (nmoved_ >= amoved_) {
+    amoved_ = amoved_ ? 2 * amoved_ : 16;
+    moved_ = (Fl_Widget**)realloc(moved_, amoved_ * sizeof(Fl_Widget*));
+  }
+  moved_[nmoved_++] = o;
+}
+
+// returns the indexes of the children that may contain X, Y
+const int *Fl_Group_Index::lookup(const Fl_Group *g, int X, int Y, int &n) {
+  if (!dirty_ && nmoved_ > g->children() / 8) dirty_ = 1; // cheaper to rebuild
+  if (dirty_) rebuild(g);
+  for (int m = 0; m < nmoved_; m++) {
+    int i = g->find(moved_[m]);
+    if (i >= g->children()) continue;
+    int r[4];
+    range(moved_[m], r);
+    int *old = range_ + 4 * i;
+    if (r[0] == old[0] && r[1] == old[1] && r[2] == old[2] && r[3] == old[3]) continue;
+    remove(i, old);
+    add(i, r);
+    old[0] = r[0]; old[1] = r[1]; old[2] = r[2]; old[3] = r[3];
+  }
+  nmoved_ = 0;
+  if (!cols_) {n = 0; return 0;}
+  int col = (X - x_) / cw_, row = (Y - y_) / ch_;
+  if (X < x_ || col < 0) col = 0; else if (col >= cols_) col = cols_ - 1;
+  if (Y < y_ || row < 0) row = 0; else if (row >= rows_) row = rows_ - 1;
+  Cell &c = cells_[row * cols_ + col];
+  n = c.n;
+  return c.child;
+}
+
+// The children that may contain the mouse, topmost first: all children,
+// or a copy of the index cell under the mouse. The copy is used in case
+// an event handler changes the group while the list is walked.
+class Fl_Group_Hit_List {
+  int *list_;
+  int n_;
+  int buffer_[32];
+public:
+  Fl_Group_Hit_List(const Fl_Group *g, Fl_Group_Index *index) {
+    list_ = 0;
+    n_ = g->children();
+    if (!index) return;
+    const int *l = index->lookup(g, Fl::event_x(), Fl::event_y(), n_);
+    list_ = n_ <= 32 ? buffer_ : new int[n_];
+    for (int i = 0; i < n_; i++) list_[i] = l[i];
+  }
+  ~Fl_Group_Hit_List() {if (list_ != buffer_) delete[] list_;}
+  // returns the next child index, or -1 at the end
+  int next(int children) {
+    while (n_ > 0) {
+      int i = list_ ? list_[--n_] : --n_;
+      if (i < children) return i;
+    }
+    return -1;
+  }
+};
+
+/**
+  Keeps a spatial index of the children to find the child under the mouse.
+
+  By default Fl_Group::handle() checks every child, from the last to the
+  first, to find the one that gets a mouse event. With the index, only
+  the children near the mouse are checked, which makes a big difference
+  for groups with thousands of children. The order of the children
+  is respected, so the topmost child still wins.
+
+  The index is updated when children are added, removed or resized with
+  resize(), position() or size(), and when the group is resized. It costs
+  a few integers per child and some time to rebuild after changes, so it
+  is only worth it for large groups with few changes between events.
+*/
+void Fl_Group::spatial_index(int on) {
+  if (on && !index_) index_ = new Fl_Group_Index;
+  else if (!on && index_) {delete index_; index_ = 0;}
+}
+
+// Called by Fl_Widget::resize() of a child when the group has an index
+void Fl_Group::child_resized_(Fl_Widget *o) {
+  index_->moved(o);
+}
+
+////////////////////////////////////////////////////////////////
+// Deferred layout:
+
+// groups resized with defer_layout() set, waiting for flush_layout():
+static Fl_Group **layout_queue;
+static int num_layout_queue, alloc_layout_queue;
+static char laying_out; // flush_layout() is running
+
+// Lays out the children of g, with laying_out set. This goes through the
+// virtual resize() so that subclasses that do more work after
+// Fl_Group::resize() redo it with the children laid out. Windows only
+// replay Fl_Group::resize(), because their resize() would resize the
+// native window again, and their driver skips the children when the
+// size did not change.
+static void replay_layout(Fl_Group *g) {
+  if (g->as_window()) g->Fl_Group::resize(g->x(), g->y(), g->w(), g->h());
+  else g->resize(g->x(), g->y(), g->w(), g->h());
+}
+
+// lays out the children of g now if a deferred layout is pending
+static void layout_now(Fl_Group *g) {
+  if (!g->layout_pending()) return;
+  char l = laying_out;
+  laying_out = 1;
+  replay_layout(g);
+  laying_out = l;
+}
+
+static void queue_layout(Fl_Group *g) {
+  if (num_layout_queue >= alloc_layout_queue) {
+    alloc_layout_queue = alloc_layout_queue ? 2 * alloc_layout_queue : 16;
+    layout_queue = (Fl_Group**)realloc(layout_queue, alloc_layout_queue * sizeof(Fl_Group*));
+  }
+  layout_queue[num_layout_queue++] = g;
+}
+
+// removes g from the queue and forgets its size at the last layout
+void Fl_Group::unqueue_layout(Fl_Group *g) {
+  for (int i = num_layout_queue; i--;)
+    if (layout_queue[i] == g) {layout_queue[i] = 0; break;}
+  delete g->layout_from_;
+  g->layout_from_ = 0;
+}
+
+/**
+  Sets whether resize() lays out the children immediately or later.
+
+  By default (\p d is 0) resize() computes and sets the size and position
+  of every child, and of their children, each time it is called. When an
+  interactive resize of a window resizes it many times between two
+  drawings, all but the last layout are wasted.
+
+  With \p d set, resize() only changes the size of the group and marks
+  it as pending. The children are laid out once, from the size the group
+  had at the last layout, by flush_layout(), which is called before
+  windows are drawn and before events are handled. All groups inside
+  this one are laid out at the same time, so it is enough to set this
+  on the window.
+
+  Code that needs the new sizes of the children right after resize()
+  can call flush_layout() itself.
+
+  When a subclass overrides resize(), its resize() is called again by
+  flush_layout() once the children are laid out, so work done after
+  calling Fl_Group::resize(), such as placing scrollbars, is redone with
+  the final layout. For windows only Fl_Group::resize() is called again,
+  so a window subclass must not depend on its children in resize() when
+  this is set.
+*/
+void Fl_Group::defer_layout(int d) {
+  if (d) set_flag(DEFER_LAYOUT);
+  else {
+    clear_flag(DEFER_LAYOUT);
+    layout_now(this);
+  }
+}
+
+/**
+  Lays out the children of all the groups resized since the last call.
+  This does nothing if no group with defer_layout() set was resized.
+
+  Fl::flush() and Fl::handle() call this, so it is only needed by code
+  that reads the sizes of children after a deferred resize().
+*/
+void Fl_Group::flush_layout() {
+  if (!num_layout_queue || laying_out) return;
+  laying_out = 1;
+  for (int i = 0; i < num_layout_queue; i++) {
+    Fl_Group *g = layout_queue[i];
+    if (!g) continue; // already laid out by a parent, or deleted
+    if (g->x() == g->layout_from_->x() && g->y() == g->layout_from_->y() &&
+        g->w() == g->layout_from_->w() && g->h() == g->layout_from_->h()) {
+      unqueue_layout(g); // back to the same size, nothing to do
+      continue;
+    }
+    replay_layout(g);
+  }
+  num_layout_queue = 0;
+  laying_out = 0;
+}
+
 // For back-compatibility, we must adjust all events sent to child
 // windows so they are relative to that window.
 
@@ -172,7 +489,7 @@ int Fl_Group::handle(int event) {
     return navigation(navkey());
 
   case FL_SHORTCUT:
-    for (i = children(); i--;) {
+    for (Fl_Group_Hit_List h(this, index_); (i = h.next(children())) >= 0;) {
       o = a[i];
       if (o->takesevents() && Fl::event_inside(o) && send(o,FL_SHORTCUT))
 	return 1;
@@ -187,7 +504,7 @@ int Fl_Group::handle(int event) {
 
   case FL_ENTER:
   case FL_MOVE:
-    for (i = children(); i--;) {
+    for (Fl_Group_Hit_List h(this, index_); (i = h.next(children())) >= 0;) {
       o = a[i];
       if (o->visible() && Fl::event_inside(o)) {
 	if (o->contains(Fl::belowmouse())) {
@@ -203,7 +520,7 @@ int Fl_Group::handle(int event) {
 
   case FL_DND_ENTER:
   case FL_DND_DRAG:
-    for (i = children(); i--;) {
+    for (Fl_Group_Hit_List h(this, index_); (i = h.next(children())) >= 0;) {
       o = a[i];
       if (o->takesevents() && Fl::event_inside(o)) {
 	if (o->contains(Fl::belowmouse())) {
@@ -218,7 +535,7 @@ int Fl_Group::handle(int event) {
     return 0;
 
   case FL_PUSH:
-    for (i = children(); i--;) {
+    for (Fl_Group_Hit_List h(this, index_); (i = h.next(children())) >= 0;) {
       o = a[i];
       if (o->takesevents() && Fl::event_inside(o)) {
 	Fl_Widget_Tracker wp(o);
@@ -236,7 +553,7 @@ int Fl_Group::handle(int event) {
     if (o == this) return 0;
     else if (o) send(o,event);
     else {
-      for (i = children(); i--;) {
+      for (Fl_Group_Hit_List h(this, index_); (i = h.next(children())) >= 0;) {
 	o = a[i];
 	if (o->takesevents() && Fl::event_inside(o)) {
 	  if (send(o,event)) return 1;
@@ -246,7 +563,7 @@ int Fl_Group::handle(int event) {
     return 0;
 
   case FL_MOUSEWHEEL:
-    for (i = children(); i--;) {
+    for (Fl_Group_Hit_List h(this, index_); (i = h.next(children())) >= 0;) {
       o = a[i];
       if (o->takesevents() && Fl::event_inside(o) && send(o,FL_MOUSEWHEEL))
 	return 1;
@@ -366,6 +683,10 @@ Fl_Group::Fl_Group(int X,int Y,int W,int H,const char *l)
   resizable_ = this;
   bounds_ = 0; // this is allocated when first resize() is done
   sizes_ = 0; // see bounds_ (FLTK 1.3 compatibility)
+  index_ = 0;
+  alloc_ = 0;
+  hint_ = 0;
+  layout_from_ = 0;
 
   // Subclasses may want to construct child objects as part of their
   // constructor, so make sure they are add()'d to this object.
@@ -451,6 +772,8 @@ void Fl_Group::clear() {
 */
 Fl_Group::~Fl_Group() {
   clear();
+  delete index_;
+  if (layout_from_) unqueue_layout(this);
 }
 
 /**
@@ -460,6 +783,7 @@ Fl_Group::~Fl_Group() {
   the widgets inside a group.
 */
 void Fl_Group::insert(Fl_Widget &o, int index) {
+  layout_now(this); // lay out the children for the current size first
   if (o.parent()) {
     Fl_Group* g = o.parent();
     int n = g->find(o);
@@ -474,16 +798,20 @@ void Fl_Group::insert(Fl_Widget &o, int index) {
     array_ = (Fl_Widget**)&o;
   } else if (children_ == 1) { // go from 1 to 2 children
     Fl_Widget* t = (Fl_Widget*)array_;
-    array_ = (Fl_Widget**)malloc(2*sizeof(Fl_Widget*));
+    if (alloc_ < 2) alloc_ = 2;
+    array_ = (Fl_Widget**)malloc(alloc_*sizeof(Fl_Widget*));
     if (index) {array_[0] = t; array_[1] = &o;}
     else {array_[0] = &o; array_[1] = t;}
   } else {
-    if (!(children_ & (children_-1))) // double number of children
+    if (children_ >= alloc_) { // double number of children
+      alloc_ = 2*children_;
       array_ = (Fl_Widget**)realloc((void*)array_,
-				    2*children_*sizeof(Fl_Widget*));
+				    alloc_*sizeof(Fl_Widget*));
+    }
     int j; for (j = children_; j > index; j--) array_[j] = array_[j-1];
     array_[j] = &o;
   }
+  hint_ = index < children_ ? index : children_;
   children_++;
   init_sizes();
 }
@@ -506,6 +834,7 @@ void Fl_Group::add(Fl_Widget &o) {insert(o, children_);}
 */
 void Fl_Group::remove(int index) {
   if (index < 0 || index >= children_) return;
+  layout_now(this);
   Fl_Widget &o = *child(index);
   if (&o == savedfocus_) savedfocus_ = 0;
   if (o.parent_ == this) {	// this should always be true
@@ -515,10 +844,12 @@ void Fl_Group::remove(int index) {
   // remove the widget from the group
 
   children_--;
+  hint_ = index;
   if (children_ == 1) { // go from 2 to 1 child
     Fl_Widget *t = array_[!index];
     free((void*)array_);
     array_ = (Fl_Widget**)t;
+    alloc_ = 0;
   } else if (children_ > 1) { // delete from array
     for (; index < children_; index++) array_[index] = array_[index+1];
   }
@@ -544,6 +875,96 @@ void Fl_Group::remove(Fl_Widget &o) {
   if (i < children_) remove(i);
 }
 
+/**
+  Makes room for \p n children, so that adding children up to that number
+  does not reallocate the array of children.
+
+  This does nothing if the group already has room for \p n children.
+
+  \see add_many()
+*/
+void Fl_Group::reserve(int n) {
+  if (n <= alloc_) return;
+  if (children_ > 1)
+    array_ = (Fl_Widget**)realloc((void*)array_, n*sizeof(Fl_Widget*));
+  alloc_ = n;
+}
+
+/**
+  Adds \p n widgets at the end of the group, in the order given.
+
+  This does the same as calling add() for each widget, but it takes
+  linear time and the array of children is grown at most once. Widgets
+  that are already children of this group are moved to the end. The
+  widgets must be different and not NULL.
+
+  \see remove_many(), reserve()
+*/
+void Fl_Group::add_many(Fl_Widget*const* widgets, int n) {
+  if (n <= 0) return;
+  layout_now(this);
+  // remove the widgets from other groups, and from this one in one pass:
+  for (int i = 0; i < n; i++) {
+    Fl_Group *g = widgets[i]->parent();
+    if (g && g != this) g->remove(*widgets[i]);
+  }
+  remove_many(widgets, n);
+  int total = children_ + n;
+  if (total == 1) { // use array pointer to point at single child
+    array_ = (Fl_Widget**)widgets[0];
+  } else {
+    if (children_ <= 1) { // go to an allocated array
+      Fl_Widget *t = (Fl_Widget*)array_;
+      if (alloc_ < total) alloc_ = total;
+      array_ = (Fl_Widget**)malloc(alloc_*sizeof(Fl_Widget*));
+      if (children_) array_[0] = t;
+    } else if (alloc_ < total) {
+      alloc_ = total;
+      array_ = (Fl_Widget**)realloc((void*)array_, alloc_*sizeof(Fl_Widget*));
+    }
+    for (int i = 0; i < n; i++) array_[children_ + i] = widgets[i];
+  }
+  for (int i = 0; i < n; i++) widgets[i]->parent_ = this;
+  hint_ = children_;
+  children_ = total;
+  init_sizes();
+}
+
+/**
+  Removes \p n widgets from the group but does not delete them.
+
+  This does the same as calling remove(Fl_Widget&) for each widget, but
+  it takes linear time in the number of children, whatever the order of
+  the widgets. Widgets that are not children of this group are ignored.
+
+  \see add_many()
+*/
+void Fl_Group::remove_many(Fl_Widget*const* widgets, int n) {
+  layout_now(this);
+  int removed = 0;
+  for (int i = 0; i < n; i++) {
+    Fl_Widget *o = widgets[i];
+    if (!o || o->parent_ != this) continue;
+    if (o == savedfocus_) savedfocus_ = 0;
+    o->parent_ = 0; // marks the widget for removal below
+    removed++;
+  }
+  if (!removed) return;
+  Fl_Widget **a = (Fl_Widget**)array();
+  int j = 0;
+  for (int i = 0; i < children_; i++)
+    if (a[i]->parent_ == this) a[j++] = a[i];
+  if (children_ > 1 && j <= 1) { // go from an allocated array to 0 or 1 child
+    Fl_Widget *t = j ? a[0] : 0;
+    free((void*)array_);
+    array_ = (Fl_Widget**)t;
+    alloc_ = 0;
+  }
+  children_ = j;
+  hint_ = 0;
+  init_sizes();
+}
+
 /**
   Resets the internal array of widget sizes and positions.
 
@@ -567,6 +988,8 @@ void Fl_Group::init_sizes() {
   bounds_ = 0;
   delete[] sizes_;	// FLTK 1.3 compatibility
   sizes_ = 0;		// FLTK 1.3 compatibility
+  if (index_) index_->invalidate();
+  set_flag(NEEDS_LAYOUT);
 }
 
 /**
@@ -608,11 +1031,13 @@ void Fl_Group::init_sizes() {
 Fl_Rect* Fl_Group::bounds() {
   if (!bounds_) {
     Fl_Rect* p = bounds_ = new Fl_Rect[children_+2];
-    // first thing in bounds array is the group's size:
+    // first thing in bounds array is the group's size, the size the
+    // children were laid out for if a deferred layout is pending:
+    Fl_Rect g = layout_from_ ? *layout_from_ : Fl_Rect(this);
     if (as_window())
-      p[0] = Fl_Rect(w(),h()); // x = y = 0
+      p[0] = Fl_Rect(g.w(),g.h()); // x = y = 0
     else
-      p[0] = Fl_Rect(this);
+      p[0] = g;
     // next is the resizable's size:
     int left   = p->x(); // init to the group's position and size
     int top    = p->y();
@@ -691,12 +1116,30 @@ int* Fl_Group::sizes()
 */
 void Fl_Group::resize(int X, int Y, int W, int H) {
 
+  Fl_Rect* p = bounds(); // save initial sizes and positions
+  if (index_) index_->invalidate(); // rebuilt when next used
+
+  if ((flags() & DEFER_LAYOUT) && !laying_out) {
+    // only remember the size at the last layout, see flush_layout():
+    if (!layout_from_) {
+      layout_from_ = new Fl_Rect(x(), y(), w(), h());
+      queue_layout(this);
+    }
+    Fl_Widget::resize(X,Y,W,H);
+    return;
+  }
+
   int dx = X-x();
   int dy = Y-y();
   int dw = W-w();
   int dh = H-h();
-
-  Fl_Rect* p = bounds(); // save initial sizes and positions
+  if (layout_from_) { // a deferred layout is done now
+    dx = X - layout_from_->x();
+    dy = Y - layout_from_->y();
+    dw = W - layout_from_->w();
+    dh = H - layout_from_->h();
+    unqueue_layout(this);
+  }
 
   Fl_Widget::resize(X,Y,W,H); // make new xywh values visible for children
 
@@ -762,6 +1205,34 @@ void Fl_Group::resize(int X, int Y, int W, int H) {
   }
 }
 
+// number of opaque children checked for hiding their siblings:
+static const int MAX_OCCLUDERS = 16;
+
+// returns non-zero if cull_children() is set for this group or a parent
+static int culling(const Fl_Group *g) {
+  for (; g; g = g->parent())
+    if (g->cull_children()) return 1;
+  return 0;
+}
+
+// Removes from the rectangle the part hidden by the opaque widget o, if
+// that leaves a rectangle: W or H is set to 0 if all of it is hidden.
+// Returns non-zero if the rectangle was changed.
+static int uncover(const Fl_Widget &o, int &X, int &Y, int &W, int &H) {
+  int L = o.x(), T = o.y(), R = L + o.w(), B = T + o.h();
+  if (L >= X + W || R <= X || T >= Y + H || B <= Y) return 0; // no overlap
+  int covers_x = L <= X && R >= X + W, covers_y = T <= Y && B >= Y + H;
+  if (covers_x && covers_y) {W = H = 0; return 1;}
+  if (covers_y) { // cut a vertical strip off the left or right
+    if (L <= X) {W -= R - X; X = R; return 1;}
+    if (R >= X + W) {W = L - X; return 1;}
+  } else if (covers_x) { // cut a horizontal strip off the top or bottom
+    if (T <= Y) {H -= B - Y; Y = B; return 1;}
+    if (B >= Y + H) {H = T - Y; return 1;}
+  }
+  return 0;
+}
+
 /**
   Draws all children of the group.
 
@@ -779,7 +1250,42 @@ void Fl_Group::draw_children() {
 		 h() - Fl::box_dh(box()));
   }
 
-  if (damage() & ~FL_DAMAGE_CHILD) { // redraw the entire thing:
+  if ((damage() & ~FL_DAMAGE_CHILD) && culling(this)) {
+    // redraw the entire thing, except what opaque children hide:
+    Fl_Widget *occluder[MAX_OCCLUDERS];
+    int index[MAX_OCCLUDERS];
+    int n = 0;
+    for (int i = children_; i-- && n < MAX_OCCLUDERS;) {
+      Fl_Widget *o = a[i];
+      if (o->visible() && o->type() < FL_WINDOW && Fl::box_opaque(o->box())) {
+        occluder[n] = o; index[n++] = i;
+      }
+    }
+    for (int i = 0; i < children_; i++) {
+      Fl_Widget& o = *a[i];
+      if (o.type() >= FL_WINDOW) { // a subwindow is never hidden by its siblings
+        draw_child(o);
+        draw_outside_label(o);
+        continue;
+      }
+      int X = o.x(), Y = o.y(), W = o.w(), H = o.h();
+      int clipped = 0;
+      for (int k = n; k-- && W > 0 && H > 0;) {
+        if (index[k] <= i) continue;
+        clipped |= uncover(*occluder[k], X, Y, W, H);
+      }
+      if (W <= 0 || H <= 0) {
+        o.clear_damage();
+      } else if (clipped) {
+        fl_push_clip(X, Y, W, H);
+        draw_child(o);
+        fl_pop_clip();
+      } else {
+        draw_child(o);
+      }
+      draw_outside_label(o);
+    }
+  } else if (damage() & ~FL_DAMAGE_CHILD) { // redraw the entire thing:
     for (int i=children_; i--;) {
       Fl_Widget& o = **a++;
       draw_child(o);
@@ -0,0 +1,185 @@
+//
+// "$Id$"
+//
+// Input latency tracer for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2017 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <FL/Fl_Input_Trace.H>
+#include <FL/Fl.H>
+#include <FL/Fl_System_Driver.H>
+
+#include <stdlib.h>
+
+char Fl_Input_Trace::enabled_ = 0;
+
+// Spans are written to a ring buffer. Span number n is ring[n % capacity],
+// spans from first_open to written - 1 may still wait for Fl::flush().
+static Fl_Input_Trace::Span *ring;
+static int capacity;
+static unsigned long written;     // number of spans ever started
+static unsigned long first_open;  // oldest span that may wait for drawing
+static Fl_Input_Trace::Span *current; // span of the event being handled
+static double arrival_time;       // set by arrival_() for the next event
+static unsigned long arrival_server_time;
+
+static double now() {
+  return Fl::system_driver()->monotonic_clock();
+}
+
+/**
+  Starts tracing input events, keeping the last \p capacity spans.
+  Spans recorded before are discarded.
+*/
+void Fl_Input_Trace::enable(int capacity_) {
+  if (capacity_ < 1) capacity_ = 1;
+  free(ring);
+  ring = (Span*)calloc(capacity_, sizeof(Span));
+  capacity = capacity_;
+  written = first_open = 0;
+  current = 0;
+  enabled_ = 1;
+}
+
+/** Stops tracing. The recorded spans can still be read. */
+void Fl_Input_Trace::disable() {
+  enabled_ = 0;
+  current = 0;
+}
+
+/** Returns the number of recorded spans, at most the capacity given to enable(). */
+int Fl_Input_Trace::spans() {
+  return written < (unsigned long)capacity ? (int)written : capacity;
+}
+
+/**
+  Returns a recorded span, \p i going from 0 (the oldest) to spans() - 1.
+  A span with a non-zero \p damaged count and a zero \p drawn time is
+  still waiting to be drawn.
+*/
+const Fl_Input_Trace::Span *Fl_Input_Trace::span(int i) {
+  if (i < 0 || i >= spans()) return 0;
+  return ring + (written - spans() + i) % capacity;
+}
+
+/** Discards all recorded spans. */
+void Fl_Input_Trace::clear() {
+  written = first_open = 0;
+  current = 0;
+}
+
+// Called by the platform code when it reads an input event:
+void Fl_Input_Trace::arrival_(unsigned long server_time) {
+  arrival_time = now();
+  arrival_server_time = server_time;
+}
+
+// Called by the platform code when the event read last has been
+// dispatched or filtered out, so that a later event does not get its
+// arrival time:
+void Fl_Input_Trace::discard_() {
+  arrival_time = 0;
+}
+
+// Called by Fl::handle(), returns 1 if a span was started
+int Fl_Input_Trace::begin_(int event) {
+  if (!enabled_ || current) return 0;
+  switch (event) {
+    case FL_PUSH: case FL_RELEASE: case FL_DRAG: case FL_MOVE:
+    case FL_MOUSEWHEEL: case FL_KEYDOWN: case FL_KEYUP:
+      break;
+    default:
+      return 0;
+  }
+  current = ring + written++ % capacity;
+  current->event = event;
+  current->key = 0;
+  current->server_time = arrival_time ? arrival_server_time : 0;
+  current->arrival = arrival_time ? arrival_time : now();
+  current->handled = current->drawn = 0;
+  current->damaged = 0;
+  current->widget = 0;
+  arrival_time = 0;
+  return 1;
+}
+
+// Called when Fl::handle() returns after begin_() returned 1
+void Fl_Input_Trace::end_() {
+  if (!current) return;
+  current->handled = now();
+  current->key = Fl::event_key();
+  current = 0;
+}
+
+// Called by Fl_Widget::damage()
+void Fl_Input_Trace::damage_(Fl_Widget *w) {
+  if (!current) return;
+  if (!current->damaged++) current->widget = w;
+}
+
+// Called by Fl::flush() after drawing
+void Fl_Input_Trace::flushed_() {
+  if (!enabled_) return;
+  double t = now();
+  if (written - first_open > (unsigned long)capacity) first_open = written - capacity;
+  for (; first_open < written; first_open++) {
+    Span &s = ring[first_open % capacity];
+    if (&s == current) break; // still being handled
+    if (s.damaged && !s.drawn) s.drawn = t;
+  }
+}
+
+static const char *event_name(int e) {
+  switch (e) {
+    case FL_PUSH:       return "push";
+    case FL_RELEASE:    return "release";
+    case FL_DRAG:       return "drag";
+    case FL_MOVE:       return "move";
+    case FL_MOUSEWHEEL: return "mousewheel";
+    case FL_KEYDOWN:    return "keydown";
+    case FL_KEYUP:      return "keyup";
+    default:            return "event";
+  }
+}
+
+/**
+  Writes the finished spans to \p f as a JSON object in the Chrome trace
+  event format. Each span gives an event named after the input ("push",
+  "keydown", ...) from its arrival to its drawing, containing a "handle"
+  event for the time spent in Fl::handle().
+  Times are in microseconds.
+  \returns the number of spans written, or -1 if writing failed
+*/
+int Fl_Input_Trace::write_chrome_trace(FILE *f) {
+  int n = spans(), count = 0;
+  fprintf(f, "{\"traceEvents\":[");
+  for (int i = 0; i < n; i++) {
+    const Span *s = span(i);
+    if (!s->handled || (s->damaged && !s->drawn)) continue; // not finished
+    double end = s->drawn ? s->drawn : s->handled;
+    if (count++) fputc(',', f);
+    fprintf(f, "\n{\"name\":\"%s\",\"cat\":\"input\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+            "\"ts\":%.1f,\"dur\":%.1f,\"args\":{\"key\":%d,\"server_time\":%lu,\"damaged\":%d}},",
+            event_name(s->event), s->arrival * 1e6, (end - s->arrival) * 1e6,
+            s->key, s->server_time, s->damaged);
+    fprintf(f, "\n{\"name\":\"handle\",\"cat\":\"input\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+            "\"ts\":%.1f,\"dur\":%.1f}", s->arrival * 1e6, (s->handled - s->arrival) * 1e6);
+  }
+  fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  return ferror(f) ? -1 : count;
+}
+
+//
+// End of "$Id$".
+//
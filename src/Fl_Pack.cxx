@@ -39,10 +39,17 @@ Fl_Pack::Fl_Pack(int X, int Y, int W, int H,const char *l)
 : Fl_Group(X, Y, W, H, l) {
   resizable(0);
   spacing_ = 0;
+  packed_type_ = 0;
+  packed_box_ = 0;
+  set_flag(NEEDS_LAYOUT);
   // type(VERTICAL); // already set like this
 }
 
-void Fl_Pack::draw() {
+// Moves and resizes the children next to each other and resizes the pack
+// to surround them. This is only done when a child was added, removed,
+// resized, shown or hidden, or when the pack itself was changed.
+// Returns non-zero if anything moved.
+int Fl_Pack::layout_children() {
   int tx = x()+Fl::box_dx(box());
   int ty = y()+Fl::box_dy(box());
   int tw = w()-Fl::box_dw(box());
@@ -50,7 +57,7 @@ void Fl_Pack::draw() {
   int rw, rh;
   int current_position = horizontal() ? tx : ty;
   int maximum_position = current_position;
-  uchar d = damage();
+  int changed = 0;
   Fl_Widget*const* a = array();
   if (horizontal()) {
     rw = -spacing_;
@@ -93,23 +100,11 @@ void Fl_Pack::draw() {
         else
           H = th - rh;
       }
-      if (spacing_ && current_position>maximum_position && box() &&
-        (X != o->x() || Y != o->y() || d&FL_DAMAGE_ALL)) {
-        fl_color(color());
-        if (horizontal())
-          fl_rectf(maximum_position, ty, spacing_, th);
-        else
-          fl_rectf(tx, maximum_position, tw, spacing_);
-      }
       if (X != o->x() || Y != o->y() || W != o->w() || H != o->h()) {
         o->resize(X,Y,W,H);
         o->clear_damage(FL_DAMAGE_ALL);
+        changed = 1;
       }
-      if (d&FL_DAMAGE_ALL) {
-        draw_child(*o);
-        draw_outside_label(*o);
-      } else update_child(*o);
-      // child's draw() can change it's size, so use new size:
       current_position += (horizontal() ? o->w() : o->h());
       if (current_position > maximum_position)
         maximum_position = current_position;
@@ -117,29 +112,74 @@ void Fl_Pack::draw() {
     }
   }
   
-  if (horizontal()) {
-    if (maximum_position < tx+tw && box()) {
-      fl_color(color());
-      fl_rectf(maximum_position, ty, tx+tw-maximum_position, th);
-    }
-    tw = maximum_position-tx;
-  } else {
-    if (maximum_position < ty+th && box()) {
-      fl_color(color());
-      fl_rectf(tx, maximum_position, tw, ty+th-maximum_position);
-    }
-    th = maximum_position-ty;
-  }
+  if (horizontal()) tw = maximum_position-tx;
+  else th = maximum_position-ty;
   
   tw += Fl::box_dw(box()); if (tw <= 0) tw = 1;
   th += Fl::box_dh(box()); if (th <= 0) th = 1;
   if (tw != w() || th != h()) {
     Fl_Widget::resize(x(),y(),tw,th);
-    d = FL_DAMAGE_ALL;
+    changed = 1;
+  }
+  packed_type_ = type();
+  packed_box_ = box();
+  clear_flag(NEEDS_LAYOUT); // set again by the resize() of the children
+  return changed;
+}
+
+void Fl_Pack::draw() {
+  uchar d = damage();
+  if ((flags() & NEEDS_LAYOUT) || type() != packed_type_ || box() != packed_box_) {
+    if (layout_children()) d = FL_DAMAGE_ALL;
   }
-  if (d&FL_DAMAGE_ALL) {
-    draw_box();
-    draw_label();
+  for (int pass = 0; ; pass++) {
+    int tx = x()+Fl::box_dx(box());
+    int ty = y()+Fl::box_dy(box());
+    int tw = w()-Fl::box_dw(box());
+    int th = h()-Fl::box_dh(box());
+    int maximum_position = horizontal() ? tx : ty;
+    int first = 1;
+    Fl_Widget*const* a = array();
+    for (int i = children(); i--;) {
+      Fl_Widget* o = *a++;
+      if (!o->visible()) continue;
+      if (spacing_ && !first && box() && (d&FL_DAMAGE_ALL)) {
+        fl_color(color());
+        if (horizontal())
+          fl_rectf(maximum_position, ty, spacing_, th);
+        else
+          fl_rectf(tx, maximum_position, tw, spacing_);
+      }
+      if (d&FL_DAMAGE_ALL) {
+        draw_child(*o);
+        draw_outside_label(*o);
+      } else update_child(*o);
+      int end = horizontal() ? o->x() + o->w() : o->y() + o->h();
+      if (end > maximum_position) maximum_position = end;
+      first = 0;
+    }
+
+    if (horizontal()) {
+      if (maximum_position < tx+tw && box()) {
+        fl_color(color());
+        fl_rectf(maximum_position, ty, tx+tw-maximum_position, th);
+      }
+    } else {
+      if (maximum_position < ty+th && box()) {
+        fl_color(color());
+        fl_rectf(tx, maximum_position, tw, ty+th-maximum_position);
+      }
+    }
+
+    if (d&FL_DAMAGE_ALL) {
+      draw_box();
+      draw_label();
+    }
+
+    // a child's draw() can change its size, then draw again with the new layout:
+    if (pass || !(flags() & NEEDS_LAYOUT)) break;
+    layout_children();
+    d = FL_DAMAGE_ALL;
   }
 }
 
@@ -0,0 +1,216 @@
+//
+// "$Id$"
+//
+// Event loop profiler for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2017 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <FL/Fl_Profiler.H>
+#include <FL/Fl.H>
+#include <FL/Fl_Double_Window.H>
+#include <FL/Fl_System_Driver.H>
+#include <FL/fl_draw.H>
+#include "flstring.h"
+
+#include <stdlib.h>
+
+char   Fl_Profiler::enabled_ = 0;
+double Fl_Profiler::budget_ = 1.0 / 60;
+
+// The entries are kept in an array, found through a hash table that
+// holds their index + 1, with linear probing:
+static Fl_Profiler::Entry *entries_;
+static int num_entries, alloc_entries;
+static int *hash_table;
+static int hash_size; // a power of 2, at least twice num_entries
+
+static unsigned hash_key(int kind, Fl_Profiler::Function function, void *data) {
+  fl_uintptr_t h = (fl_uintptr_t)function * 31 + (fl_uintptr_t)data;
+  h = h * 7 + kind;
+  return (unsigned)(h ^ (h >> 7) ^ (h >> 17));
+}
+
+static void rehash(int size) {
+  free(hash_table);
+  hash_table = (int*)calloc(size, sizeof(int));
+  hash_size = size;
+  for (int i = 0; i < num_entries; i++) {
+    Fl_Profiler::Entry &e = entries_[i];
+    unsigned h = hash_key(e.kind, e.function, e.data) & (hash_size - 1);
+    while (hash_table[h]) h = (h + 1) & (hash_size - 1);
+    hash_table[h] = i + 1;
+  }
+}
+
+static Fl_Profiler::Entry *find_entry(Fl_Profiler::Kind kind,
+                                      Fl_Profiler::Function function, void *data) {
+  if (!hash_size) rehash(64);
+  unsigned h = hash_key(kind, function, data) & (hash_size - 1);
+  for (; hash_table[h]; h = (h + 1) & (hash_size - 1)) {
+    Fl_Profiler::Entry *e = entries_ + hash_table[h] - 1;
+    if (e->kind == kind && e->function == function && e->data == data) return e;
+  }
+  if (num_entries >= alloc_entries) {
+    alloc_entries = alloc_entries ? 2 * alloc_entries : 32;
+    entries_ = (Fl_Profiler::Entry*)realloc(entries_, alloc_entries * sizeof(Fl_Profiler::Entry));
+  }
+  Fl_Profiler::Entry *e = entries_ + num_entries++;
+  memset(e, 0, sizeof(*e));
+  e->kind = kind;
+  e->function = function;
+  e->data = data;
+  if (2 * num_entries > hash_size) rehash(2 * hash_size);
+  else hash_table[h] = num_entries;
+  return e;
+}
+
+/**
+  Enables or disables the profiler.
+  The statistics collected so far are kept, see reset().
+*/
+void Fl_Profiler::enable(int on) {
+  enabled_ = (on != 0);
+}
+
+/** Returns the number of callbacks that have been timed. */
+int Fl_Profiler::entries() {
+  return num_entries;
+}
+
+/**
+  Returns the statistics of a callback, \p i going from 0 to entries() - 1.
+  The pointer is only valid until the next callback is timed.
+*/
+const Fl_Profiler::Entry *Fl_Profiler::entry(int i) {
+  return (i >= 0 && i < num_entries) ? entries_ + i : 0;
+}
+
+/** Forgets all statistics. */
+void Fl_Profiler::reset() {
+  num_entries = 0;
+  if (hash_table) memset(hash_table, 0, hash_size * sizeof(int));
+}
+
+double Fl_Profiler::now_() {
+  return Fl::system_driver()->monotonic_clock();
+}
+
+void Fl_Profiler::stop_(Kind kind, Function function, void *data, double start) {
+  double t = now_() - start;
+  Entry *e = find_entry(kind, function, data);
+  e->count++;
+  e->total += t;
+  if (t > e->maximum) e->maximum = t;
+  if (t > budget_) e->overruns++;
+  int b = 0;
+  for (double us = t * 1e6; us >= 1 && b < BUCKETS - 1; us /= 2) b++;
+  e->histogram[b]++;
+}
+
+////////////////////////////////////////////////////////////////
+// The overlay window:
+
+static const char *kind_names[Fl_Profiler::KINDS] = {
+  "timeout", "fd", "awake", "check", "idle", "event", "draw"
+};
+
+class Fl_Profiler_Overlay : public Fl_Double_Window {
+public:
+  Fl_Profiler_Overlay() : Fl_Double_Window(520, 260, "Event loop profile") {}
+  void draw();
+  static void update(void *);
+};
+
+static Fl_Profiler_Overlay *overlay;
+
+static int compare_total(const void *a, const void *b) {
+  double ta = entries_[*(const int*)a].total, tb = entries_[*(const int*)b].total;
+  return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+void Fl_Profiler_Overlay::draw() {
+  fl_color(FL_BLACK);
+  fl_rectf(0, 0, w(), h());
+  fl_font(FL_COURIER, 12);
+  int lh = fl_height(), y = lh;
+  char buf[100];
+  fl_color(FL_WHITE);
+  snprintf(buf, sizeof(buf), "%-8s %-18s %8s %8s %8s %6s", "kind", "callback",
+           "calls", "avg ms", "max ms", "over");
+  fl_draw(buf, 4, y - fl_descent());
+  int hx = 4 + (int)fl_width(buf) + 8;
+  if (!Fl_Profiler::enabled()) fl_draw("(disabled)", hx, y - fl_descent());
+  int n = num_entries;
+  int *order = new int[n > 0 ? n : 1];
+  for (int i = 0; i < n; i++) order[i] = i;
+  qsort(order, n, sizeof(int), compare_total);
+  for (int i = 0; i < n && y + lh <= h(); i++) {
+    const Fl_Profiler::Entry &e = entries_[order[i]];
+    char name[40];
+    if (e.kind == Fl_Profiler::FLUSH && e.data) {
+      // the window may have been deleted, only use it if it is still shown:
+      Fl_Window *win = Fl::first_window();
+      while (win && win != e.data) win = Fl::next_window(win);
+      if (win && win->label()) snprintf(name, sizeof(name), "%.18s", win->label());
+      else snprintf(name, sizeof(name), "%p", e.data);
+    } else if (e.function) snprintf(name, sizeof(name), "%p", (void*)(fl_uintptr_t)e.function);
+    else strcpy(name, "-");
+    y += lh;
+    fl_color(e.overruns ? FL_RED : FL_GREEN);
+    snprintf(buf, sizeof(buf), "%-8s %-18s %8u %8.3f %8.3f %6u", kind_names[e.kind], name,
+             e.count, e.count ? 1000 * e.total / e.count : 0.0, 1000 * e.maximum, e.overruns);
+    fl_draw(buf, 4, y - fl_descent());
+    // histogram, one bar per bucket:
+    unsigned most = 1;
+    for (int b = 0; b < Fl_Profiler::BUCKETS; b++) if (e.histogram[b] > most) most = e.histogram[b];
+    for (int b = 0; b < Fl_Profiler::BUCKETS; b++) {
+      int bh = int((lh - 2) * (double)e.histogram[b] / most + 0.5);
+      if (bh) fl_rectf(hx + 3 * b, y - 1 - bh, 2, bh);
+    }
+  }
+  delete[] order;
+}
+
+void Fl_Profiler_Overlay::update(void *) {
+  overlay->redraw();
+  Fl::repeat_timeout(0.5, update);
+}
+
+/**
+  Shows a window with the statistics of the callbacks that took the most
+  time, updated twice a second. Each line shows a histogram of the call
+  durations, and callbacks that overran the budget are shown in red.
+*/
+void Fl_Profiler::show_overlay() {
+  if (!overlay) {
+    Fl_Group *g = Fl_Group::current();
+    Fl_Group::current(0);
+    overlay = new Fl_Profiler_Overlay;
+    overlay->end();
+    Fl_Group::current(g);
+  }
+  overlay->show();
+  if (!Fl::has_timeout(Fl_Profiler_Overlay::update))
+    Fl::add_timeout(0.5, Fl_Profiler_Overlay::update);
+}
+
+/** Hides the window shown by show_overlay(). */
+void Fl_Profiler::hide_overlay() {
+  Fl::remove_timeout(Fl_Profiler_Overlay::update);
+  if (overlay) overlay->hide();
+}
+
+//
+// End of "$Id$".
+//
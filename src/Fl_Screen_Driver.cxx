@@ -134,6 +134,12 @@ const char *Fl_Screen_Driver::get_system_scheme()
   return 0L;
 }
 
+
+int Fl_Screen_Driver::input_pending()
+{
+  return 0;
+}
+
 /** The bullet character used by default by Fl_Secret_Input */
 int Fl_Screen_Driver::secret_input_character = 0x2022;
 
@@ -31,6 +31,7 @@ void Fl_Scroll::clear() {
   remove(scrollbar);
   remove(hscrollbar);
   Fl_Group::clear();
+  scroll_dx_ = scroll_dy_ = 0; // the deferred scrolling was for the deleted children
   add(hscrollbar);
   add(scrollbar);
 }
@@ -100,6 +101,7 @@ void Fl_Scroll::draw_clip(void* v,int X, int Y, int W, int H) {
   \returns Structure containing the calculated info.
 */
 void Fl_Scroll::recalc_scrollbars(ScrollInfo &si) {
+  flush_scroll();
 
   // inner box of widget (excluding scrollbars)
   si.innerbox.x = x()+Fl::box_dx(box());
@@ -239,6 +241,7 @@ void Fl_Scroll::bbox(int& X, int& Y, int& W, int& H) {
 
 void Fl_Scroll::draw() {
   fix_scrollbar_order();
+  flush_scroll();
   int X,Y,W,H; bbox(X,Y,W,H);
 
   uchar d = damage();
@@ -360,12 +363,10 @@ void Fl_Scroll::resize(int X, int Y, int W, int H) {
   int dw = W-w(), dh = H-h();
   Fl_Widget::resize(X,Y,W,H); // resize _before_ moving children around
   fix_scrollbar_order();
-  // move all the children:
-  Fl_Widget*const* a = array();
-  for (int i=children()-2; i--;) {
-    Fl_Widget* o = *a++;
-    o->position(o->x()+dx, o->y()+dy);
-  }
+  // move all the children, together with a deferred scrolling:
+  dx += scroll_dx_; dy += scroll_dy_;
+  scroll_dx_ = scroll_dy_ = 0;
+  move_children(dx, dy);
   if (dw==0 && dh==0) {
     char pad = ( scrollbar.visible() && hscrollbar.visible() );
     char al = ( (scrollbar.align() & FL_ALIGN_LEFT) != 0 );
@@ -400,14 +401,56 @@ void Fl_Scroll::scroll_to(int X, int Y) {
   if (!dx && !dy) return;
   xposition_ = X;
   yposition_ = Y;
+  if (defer_scroll_) {
+    scroll_dx_ += dx;
+    scroll_dy_ += dy;
+  } else {
+    move_children(dx, dy);
+  }
+  if (parent() == (Fl_Group *)window() && Fl::scheme_bg_) damage(FL_DAMAGE_ALL);
+  else damage(FL_DAMAGE_SCROLL);
+}
+
+// moves all children except the scrollbars
+void Fl_Scroll::move_children(int dx, int dy) {
+  if (!dx && !dy) return;
   Fl_Widget*const* a = array();
   for (int i=children(); i--;) {
     Fl_Widget* o = *a++;
     if (o == &hscrollbar || o == &scrollbar) continue;
     o->position(o->x()+dx, o->y()+dy);
   }
-  if (parent() == (Fl_Group *)window() && Fl::scheme_bg_) damage(FL_DAMAGE_ALL);
-  else damage(FL_DAMAGE_SCROLL);
+}
+
+/**
+  Sets whether scroll_to() moves the children immediately or later.
+
+  By default (\p d is 0) scroll_to() moves every child, which takes time
+  in proportion to the number of children for every scrollbar movement.
+  With \p d set, scroll_to() only adds to an offset, and the children are
+  moved once by flush_scroll(), which is called before the widget is drawn
+  and before it handles an event. Scrolling many times between two
+  drawings then costs a single pass over the children.
+
+  Until then, x() and y() of the children are their positions before
+  scrolling: use child_x() and child_y(), or call flush_scroll(), to get
+  their positions after scrolling. Call flush_scroll() before adding
+  children positioned for the new scrolling position.
+*/
+void Fl_Scroll::defer_scroll(int d) {
+  if (!d) flush_scroll();
+  defer_scroll_ = (d != 0);
+}
+
+/**
+  Moves the children by the offset accumulated by scroll_to() since they
+  were last moved. This does nothing unless defer_scroll() is set.
+*/
+void Fl_Scroll::flush_scroll() {
+  if (!scroll_dx_ && !scroll_dy_) return;
+  int dx = scroll_dx_, dy = scroll_dy_;
+  scroll_dx_ = scroll_dy_ = 0;
+  move_children(dx, dy);
 }
 
 void Fl_Scroll::hscrollbar_cb(Fl_Widget* o, void*) {
@@ -440,6 +483,8 @@ Fl_Scroll::Fl_Scroll(int X,int Y,int W,int H,const char* L)
   xposition_ = oldx = 0;
   yposition_ = oldy = 0;
   scrollbar_size_ = 0;
+  scroll_dx_ = scroll_dy_ = 0;
+  defer_scroll_ = 0;
   hscrollbar.type(FL_HORIZONTAL);
   hscrollbar.callback(hscrollbar_cb);
   scrollbar.callback(scrollbar_cb);
@@ -447,6 +492,7 @@ Fl_Scroll::Fl_Scroll(int X,int Y,int W,int H,const char* L)
 
 int Fl_Scroll::handle(int event) {
   fix_scrollbar_order();
+  flush_scroll();
   return Fl_Group::handle(event);
 }
 
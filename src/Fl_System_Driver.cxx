@@ -445,6 +445,14 @@ void Fl_System_Driver::gettime(time_t *sec, int *usec) {
   *usec = 0;
 }
 
+// Get elapsed time in seconds, for measuring durations.
+double Fl_System_Driver::monotonic_clock() {
+  time_t sec;
+  int usec;
+  gettime(&sec, &usec);
+  return sec + usec/1000000.0;
+}
+
 //
 // End of "$Id$".
 //
@@ -0,0 +1,526 @@
+//
+// "$Id$"
+//
+// Worker thread pool for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2017 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include "config_lib.h"
+#include <FL/Fl.H>
+#include <FL/Fl_Task_Pool.H>
+
+#include <stdlib.h>
+
+#if defined(HAVE_PTHREAD)
+#  include <pthread.h>
+#  include <unistd.h>
+#  define FL_TASK_THREADS 1
+#elif defined(FL_CFG_SYS_WIN32)
+#  include <windows.h>
+#  include <process.h>
+#  define FL_TASK_THREADS 1
+#endif
+
+struct Fl_Task {
+  Fl_Task_Handler job, on_done;
+  void *data;
+  Fl_Task_Token *token;
+  Fl_Task *next;
+};
+
+// Tasks whose job has finished, waiting for the main thread to call
+// their completion function. This list is shared by all pools, so that
+// the awake handler that empties it never refers to a deleted pool.
+static Fl_Task *done_first, *done_last;
+
+#if defined(FL_TASK_THREADS)
+
+struct Fl_Task_Worker;
+
+////////////////////////////////////////////////////////////////
+// The few thread primitives used by the pool, for each platform.
+// wait_work() and wait_idle() are called with the pool's mutex
+// locked, and return with it locked again.
+
+#if defined(HAVE_PTHREAD)
+
+typedef pthread_mutex_t Fl_Task_Mutex;
+static void mutex_init(Fl_Task_Mutex *m) { pthread_mutex_init(m, 0); }
+static void mutex_destroy(Fl_Task_Mutex *m) { pthread_mutex_destroy(m); }
+static void mutex_lock(Fl_Task_Mutex *m) { pthread_mutex_lock(m); }
+static void mutex_unlock(Fl_Task_Mutex *m) { pthread_mutex_unlock(m); }
+
+// protects the list above and the reference counts of the tokens
+static pthread_mutex_t done_mutex = PTHREAD_MUTEX_INITIALIZER;
+static void lock_done() { pthread_mutex_lock(&done_mutex); }
+static void unlock_done() { pthread_mutex_unlock(&done_mutex); }
+
+struct Fl_Task_Pool_Lock {
+  pthread_mutex_t mutex;  // protects the shared queue and the counters
+  pthread_cond_t work;    // signalled when a job is queued or the pool stops
+  pthread_cond_t idle;    // signalled when the last outstanding job finishes
+};
+
+static void lock_init(Fl_Task_Pool_Lock *l) {
+  pthread_mutex_init(&l->mutex, 0);
+  pthread_cond_init(&l->work, 0);
+  pthread_cond_init(&l->idle, 0);
+}
+
+static void lock_destroy(Fl_Task_Pool_Lock *l) {
+  pthread_cond_destroy(&l->idle);
+  pthread_cond_destroy(&l->work);
+  pthread_mutex_destroy(&l->mutex);
+}
+
+static void wait_work(Fl_Task_Pool_Lock *l) { pthread_cond_wait(&l->work, &l->mutex); }
+static void signal_work(Fl_Task_Pool_Lock *l, int) { pthread_cond_signal(&l->work); }
+static void broadcast_work(Fl_Task_Pool_Lock *l, int) { pthread_cond_broadcast(&l->work); }
+static void wait_idle(Fl_Task_Pool_Lock *l) { pthread_cond_wait(&l->idle, &l->mutex); }
+static void signal_idle(Fl_Task_Pool_Lock *l) { pthread_cond_broadcast(&l->idle); }
+static void unsignal_idle(Fl_Task_Pool_Lock *) {}
+
+typedef pthread_t Fl_Task_Thread;
+static void *run_worker(void *w);
+static int start_thread(Fl_Task_Thread *t, Fl_Task_Worker *w) {
+  return pthread_create(t, 0, run_worker, w);
+}
+static void join_thread(Fl_Task_Thread *t) { pthread_join(*t, 0); }
+
+static pthread_key_t current_worker;
+static pthread_once_t current_worker_once = PTHREAD_ONCE_INIT;
+static void make_current_worker_key() { pthread_key_create(&current_worker, 0); }
+static void init_current_worker() { pthread_once(&current_worker_once, make_current_worker_key); }
+static void set_current_worker(Fl_Task_Worker *w) { pthread_setspecific(current_worker, w); }
+static Fl_Task_Worker *get_current_worker() {
+  return (Fl_Task_Worker*)pthread_getspecific(current_worker);
+}
+
+static int processors() { return (int)sysconf(_SC_NPROCESSORS_ONLN); }
+
+#else // FL_CFG_SYS_WIN32
+
+typedef CRITICAL_SECTION Fl_Task_Mutex;
+static void mutex_init(Fl_Task_Mutex *m) { InitializeCriticalSection(m); }
+static void mutex_destroy(Fl_Task_Mutex *m) { DeleteCriticalSection(m); }
+static void mutex_lock(Fl_Task_Mutex *m) { EnterCriticalSection(m); }
+static void mutex_unlock(Fl_Task_Mutex *m) { LeaveCriticalSection(m); }
+
+// Protects the list above and the reference counts of the tokens. It is
+// created by the first pool, from the main thread, before any worker runs.
+static CRITICAL_SECTION *done_mutex;
+static void init_done() {
+  if (!done_mutex) {
+    done_mutex = (CRITICAL_SECTION*)malloc(sizeof(CRITICAL_SECTION));
+    InitializeCriticalSection(done_mutex);
+  }
+}
+static void lock_done() { init_done(); EnterCriticalSection(done_mutex); }
+static void unlock_done() { LeaveCriticalSection(done_mutex); }
+
+// A semaphore is released once for each queued job, so a worker that
+// found no work cannot miss a job queued before it starts waiting. The
+// idle event is set exactly when no job is outstanding.
+struct Fl_Task_Pool_Lock {
+  CRITICAL_SECTION mutex; // protects the shared queue and the counters
+  HANDLE work;            // released when a job is queued or the pool stops
+  HANDLE idle;            // manual-reset event, set when no job is outstanding
+};
+
+static void lock_init(Fl_Task_Pool_Lock *l) {
+  init_done();
+  InitializeCriticalSection(&l->mutex);
+  l->work = CreateSemaphore(0, 0, 0x7fffffff, 0);
+  l->idle = CreateEvent(0, TRUE, TRUE, 0);
+}
+
+static void lock_destroy(Fl_Task_Pool_Lock *l) {
+  CloseHandle(l->idle);
+  CloseHandle(l->work);
+  DeleteCriticalSection(&l->mutex);
+}
+
+static void wait_work(Fl_Task_Pool_Lock *l) {
+  LeaveCriticalSection(&l->mutex);
+  WaitForSingleObject(l->work, INFINITE);
+  EnterCriticalSection(&l->mutex);
+}
+static void signal_work(Fl_Task_Pool_Lock *l, int) { ReleaseSemaphore(l->work, 1, 0); }
+static void broadcast_work(Fl_Task_Pool_Lock *l, int n) { if (n) ReleaseSemaphore(l->work, n, 0); }
+static void wait_idle(Fl_Task_Pool_Lock *l) {
+  LeaveCriticalSection(&l->mutex);
+  WaitForSingleObject(l->idle, INFINITE);
+  EnterCriticalSection(&l->mutex);
+}
+static void signal_idle(Fl_Task_Pool_Lock *l) { SetEvent(l->idle); }
+static void unsignal_idle(Fl_Task_Pool_Lock *l) { ResetEvent(l->idle); }
+
+typedef HANDLE Fl_Task_Thread;
+static void *run_worker(void *w);
+static unsigned __stdcall run_worker_win32(void *w) { run_worker(w); return 0; }
+static int start_thread(Fl_Task_Thread *t, Fl_Task_Worker *w) {
+  *t = (HANDLE)_beginthreadex(0, 0, run_worker_win32, w, 0, 0);
+  return *t ? 0 : -1;
+}
+static void join_thread(Fl_Task_Thread *t) {
+  WaitForSingleObject(*t, INFINITE);
+  CloseHandle(*t);
+}
+
+// like the mutex above, the index is allocated by the first pool
+static DWORD current_worker = TLS_OUT_OF_INDEXES;
+static void init_current_worker() {
+  if (current_worker == TLS_OUT_OF_INDEXES) current_worker = TlsAlloc();
+}
+static void set_current_worker(Fl_Task_Worker *w) { TlsSetValue(current_worker, w); }
+static Fl_Task_Worker *get_current_worker() {
+  return (Fl_Task_Worker*)TlsGetValue(current_worker);
+}
+
+static int processors() {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int)info.dwNumberOfProcessors;
+}
+
+#endif // HAVE_PTHREAD
+
+////////////////////////////////////////////////////////////////
+
+// Each worker owns a double-ended queue, kept in a ring buffer: the
+// worker takes the newest job from the back, other workers steal the
+// oldest one from the front.
+struct Fl_Task_Worker {
+  Fl_Task_Pool *pool;
+  Fl_Task_Thread thread;
+  Fl_Task_Mutex mutex;
+  Fl_Task **jobs;
+  int head, count, size;
+  void push(Fl_Task *t);
+  Fl_Task *pop_back();
+  Fl_Task *pop_front();
+  static void *run(void *w);
+};
+
+static void *run_worker(void *w) { return Fl_Task_Worker::run(w); }
+
+void Fl_Task_Worker::push(Fl_Task *t) {
+  mutex_lock(&mutex);
+  if (count == size) {
+    int nsize = size ? 2*size : 16;
+    Fl_Task **njobs = (Fl_Task**)malloc(nsize*sizeof(Fl_Task*));
+    for (int i = 0; i < count; i++) njobs[i] = jobs[(head+i) % size];
+    free(jobs);
+    jobs = njobs;
+    head = 0;
+    size = nsize;
+  }
+  jobs[(head+count) % size] = t;
+  count++;
+  mutex_unlock(&mutex);
+}
+
+Fl_Task *Fl_Task_Worker::pop_back() {
+  Fl_Task *t = 0;
+  mutex_lock(&mutex);
+  if (count) t = jobs[(head + --count) % size];
+  mutex_unlock(&mutex);
+  return t;
+}
+
+Fl_Task *Fl_Task_Worker::pop_front() {
+  Fl_Task *t = 0;
+  mutex_lock(&mutex);
+  if (count) {
+    t = jobs[head];
+    head = (head+1) % size;
+    count--;
+  }
+  mutex_unlock(&mutex);
+  return t;
+}
+
+void *Fl_Task_Worker::run(void *data) {
+  Fl_Task_Worker *w = (Fl_Task_Worker*)data;
+  Fl_Task_Pool *pool = w->pool;
+  Fl_Task_Pool_Lock *l = (Fl_Task_Pool_Lock*)pool->lock_;
+  set_current_worker(w);
+  for (;;) {
+    Fl_Task *t = pool->next_task_(w);
+    if (t) {
+      if (!t->token || !t->token->cancelled()) t->job(t->data);
+      pool->finish_(t);
+      continue;
+    }
+    mutex_lock(&l->mutex);
+    while (!pool->queued_ && !pool->stopping_) wait_work(l);
+    int stop = pool->stopping_ && !pool->queued_;
+    mutex_unlock(&l->mutex);
+    if (stop) return 0;
+  }
+}
+
+// Finds a job for worker w: its own newest job, else the oldest job
+// submitted from outside the pool, else the oldest job of another worker.
+Fl_Task *Fl_Task_Pool::next_task_(Fl_Task_Worker *w) {
+  Fl_Task_Pool_Lock *l = (Fl_Task_Pool_Lock*)lock_;
+  Fl_Task *t = w->pop_back();
+  if (!t) {
+    mutex_lock(&l->mutex);
+    if (first_) {
+      t = first_;
+      first_ = t->next;
+      if (!first_) last_ = 0;
+      queued_--;
+    }
+    mutex_unlock(&l->mutex);
+    if (t) return t;
+    int i = int(w - workers_);
+    for (int n = 1; n < nworkers_ && !t; n++)
+      t = workers_[(i+n) % nworkers_].pop_front();
+  }
+  if (t) {
+    mutex_lock(&l->mutex);
+    queued_--;
+    mutex_unlock(&l->mutex);
+  }
+  return t;
+}
+
+/**
+  Creates a pool of \p nthreads worker threads.
+  If \p nthreads is 0 or less, one thread per processor is created.
+*/
+Fl_Task_Pool::Fl_Task_Pool(int nthreads) {
+  first_ = last_ = 0;
+  queued_ = outstanding_ = stopping_ = 0;
+  if (nthreads <= 0) nthreads = processors();
+  if (nthreads <= 0) nthreads = 1;
+  Fl_Task_Pool_Lock *l = new Fl_Task_Pool_Lock;
+  lock_init(l);
+  lock_ = l;
+  init_current_worker();
+  workers_ = new Fl_Task_Worker[nthreads];
+  nworkers_ = 0;
+  for (int i = 0; i < nthreads; i++) {
+    Fl_Task_Worker *w = workers_ + nworkers_;
+    w->pool = this;
+    w->jobs = 0;
+    w->head = w->count = w->size = 0;
+    mutex_init(&w->mutex);
+    if (start_thread(&w->thread, w)) {
+      mutex_destroy(&w->mutex);
+      break;
+    }
+    nworkers_++;
+  }
+}
+
+/**
+  Waits for all jobs (see wait()), then stops the worker threads.
+  Must be called from the main thread.
+*/
+Fl_Task_Pool::~Fl_Task_Pool() {
+  wait();
+  Fl_Task_Pool_Lock *l = (Fl_Task_Pool_Lock*)lock_;
+  mutex_lock(&l->mutex);
+  stopping_ = 1;
+  broadcast_work(l, nworkers_);
+  mutex_unlock(&l->mutex);
+  for (int i = 0; i < nworkers_; i++) {
+    join_thread(&workers_[i].thread);
+    mutex_destroy(&workers_[i].mutex);
+    free(workers_[i].jobs);
+  }
+  delete[] workers_;
+  lock_destroy(l);
+  delete l;
+}
+
+/**
+  Queues a job.
+
+  \p job(data) is called on a worker thread. When it has returned,
+  \p on_done(data) is called on the main thread, if \p on_done is
+  not NULL. If \p token is not NULL and is cancelled before the job
+  starts, the job is not run, and if it is cancelled before the main
+  thread calls \p on_done, \p on_done is not called.
+
+  \return 0 on success, -1 if the job could not be queued.
+*/
+int Fl_Task_Pool::submit(Fl_Task_Handler job, Fl_Task_Handler on_done, void *data,
+                         Fl_Task_Token *token) {
+  if (!job || !nworkers_) return -1;
+  Fl_Task *t = (Fl_Task*)malloc(sizeof(Fl_Task));
+  if (!t) return -1;
+  t->job = job;
+  t->on_done = on_done;
+  t->data = data;
+  t->token = token;
+  t->next = 0;
+  if (token) token->reference();
+  Fl_Task_Pool_Lock *l = (Fl_Task_Pool_Lock*)lock_;
+  Fl_Task_Worker *w = get_current_worker();
+  if (w && w->pool == this) w->push(t);
+  mutex_lock(&l->mutex);
+  if (!w || w->pool != this) {
+    if (last_) last_->next = t;
+    else first_ = t;
+    last_ = t;
+  }
+  queued_++;
+  if (!outstanding_++) unsignal_idle(l);
+  signal_work(l, 1);
+  mutex_unlock(&l->mutex);
+  return 0;
+}
+
+// Called by a worker thread when the job of task t has returned.
+void Fl_Task_Pool::finish_(Fl_Task *t) {
+  lock_done();
+  if (done_last) done_last->next = t;
+  else done_first = t;
+  done_last = t;
+  t->next = 0;
+  unlock_done();
+  Fl_Task_Pool_Lock *l = (Fl_Task_Pool_Lock*)lock_;
+  mutex_lock(&l->mutex);
+  if (!--outstanding_) signal_idle(l);
+  mutex_unlock(&l->mutex);
+  Fl::awake_once(run_completions_, 0);
+}
+
+/**
+  Waits until all submitted jobs have returned, then calls the pending
+  completion functions. Must be called from the main thread, typically
+  before the program exits. Jobs must not call this.
+*/
+void Fl_Task_Pool::wait() {
+  Fl_Task_Pool_Lock *l = (Fl_Task_Pool_Lock*)lock_;
+  mutex_lock(&l->mutex);
+  while (outstanding_) wait_idle(l);
+  mutex_unlock(&l->mutex);
+  run_completions_(0);
+}
+
+/** Returns the number of jobs that have been submitted and have not returned yet. */
+int Fl_Task_Pool::pending() {
+  Fl_Task_Pool_Lock *l = (Fl_Task_Pool_Lock*)lock_;
+  mutex_lock(&l->mutex);
+  int n = outstanding_;
+  mutex_unlock(&l->mutex);
+  return n;
+}
+
+#else // ! FL_TASK_THREADS
+
+static void lock_done() {}
+static void unlock_done() {}
+
+Fl_Task_Pool::Fl_Task_Pool(int) {
+  nworkers_ = 0;
+  workers_ = 0;
+  first_ = last_ = 0;
+  queued_ = outstanding_ = stopping_ = 0;
+  lock_ = 0;
+}
+
+Fl_Task_Pool::~Fl_Task_Pool() {
+  wait();
+}
+
+int Fl_Task_Pool::submit(Fl_Task_Handler job, Fl_Task_Handler on_done, void *data,
+                         Fl_Task_Token *token) {
+  if (!job) return -1;
+  Fl_Task *t = (Fl_Task*)malloc(sizeof(Fl_Task));
+  if (!t) return -1;
+  t->job = job;
+  t->on_done = on_done;
+  t->data = data;
+  t->token = token;
+  if (token) token->reference();
+  if (!token || !token->cancelled()) job(data);
+  finish_(t);
+  return 0;
+}
+
+void Fl_Task_Pool::finish_(Fl_Task *t) {
+  t->next = 0;
+  if (done_last) done_last->next = t;
+  else done_first = t;
+  done_last = t;
+  if (!Fl::has_timeout(run_completions_)) Fl::add_timeout(0.0, run_completions_);
+}
+
+void Fl_Task_Pool::wait() {
+  Fl::remove_timeout(run_completions_);
+  run_completions_(0);
+}
+
+int Fl_Task_Pool::pending() {
+  return 0;
+}
+
+#endif // FL_TASK_THREADS
+
+// Calls the completion functions of the finished jobs, on the main thread.
+void Fl_Task_Pool::run_completions_(void *) {
+  lock_done();
+  Fl_Task *t = done_first;
+  done_first = done_last = 0;
+  unlock_done();
+  while (t) {
+    Fl_Task *next = t->next;
+    if (t->on_done && (!t->token || !t->token->cancelled())) t->on_done(t->data);
+    if (t->token) t->token->release();
+    free(t);
+    t = next;
+  }
+}
+
+/**
+  Returns a pool shared by the application and the library, with one
+  worker thread per processor. It is created by the first call, which
+  should be made from the main thread.
+*/
+Fl_Task_Pool *Fl_Task_Pool::global() {
+  static Fl_Task_Pool *pool = 0;
+  if (!pool) pool = new Fl_Task_Pool;
+  return pool;
+}
+
+/** Creates a token with a reference count of 1. */
+Fl_Task_Token::Fl_Task_Token() : cancelled_(0), refcount_(1) {}
+
+/** Adds a reference to the token. This can be called from any thread. */
+void Fl_Task_Token::reference() {
+  lock_done();
+  refcount_++;
+  unlock_done();
+}
+
+/**
+  Releases a reference to the token, and deletes it when the last
+  reference is released. This can be called from any thread.
+*/
+void Fl_Task_Token::release() {
+  lock_done();
+  int n = --refcount_;
+  unlock_done();
+  if (!n) delete this;
+}
+
+//
+// End of "$Id$".
+//
@@ -0,0 +1,281 @@
+//
+// "$Id$"
+//
+// Virtual scroll widget for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2017 by Bill Spitzak and others.
+//
+// This library is free software. Distribution and use rights are outlined in
+// the file "COPYING" which should have been included with this file.  If this
+// file is missing or damaged, see the license at:
+//
+//     http://www.fltk.org/COPYING.php
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <FL/Fl.H>
+#include <FL/Fl_Virtual_Scroll.H>
+#include <FL/fl_draw.H>
+
+#include <stdlib.h>
+
+// The row widgets are the first pool_ children. Row r is always shown by
+// child r % pool_, so a row that stays visible when scrolling keeps its
+// widget, and a widget that comes back to a row it already showed is not
+// bound again.
+
+/**
+  Creates a new Fl_Virtual_Scroll widget using the given position,
+  size, and label string. The default boxtype is FL_DOWN_BOX.
+
+  The list has no rows until rows() and source() are set. Unlike most
+  groups, the widget is not left open: widgets created after it are not
+  added to it.
+*/
+Fl_Virtual_Scroll::Fl_Virtual_Scroll(int X, int Y, int W, int H, const char *L)
+  : Fl_Group(X, Y, W, H, L),
+    scrollbar(X + W - Fl::scrollbar_size(), Y, Fl::scrollbar_size(), H) {
+  rows_ = 0;
+  row_height_ = 20;
+  yposition_ = 0;
+  pool_ = 0;
+  pool_row_ = 0;
+  scrollbar_size_ = 0;
+  create_ = 0;
+  bind_ = 0;
+  source_data_ = 0;
+  box(FL_DOWN_BOX);
+  color(FL_BACKGROUND2_COLOR);
+  scrollbar.callback(scrollbar_cb);
+  scrollbar.clear_visible();
+  end();
+}
+
+/** Deletes the widget, its row widgets and its scrollbar. */
+Fl_Virtual_Scroll::~Fl_Virtual_Scroll() {
+  free(pool_row_);
+}
+
+/**
+  Deletes the row widgets, but not the scrollbar. The number of rows and
+  the source functions are kept, and new row widgets are created the next
+  time the list is scrolled, resized or bound again.
+*/
+void Fl_Virtual_Scroll::clear() {
+  // The scrollbar is a member, so it must not be deleted by Fl_Group::clear()
+  remove(scrollbar);
+  Fl_Group::clear();
+  pool_ = 0;
+  free(pool_row_);
+  pool_row_ = 0;
+  add(scrollbar);
+  redraw();
+}
+
+void Fl_Virtual_Scroll::scrollbar_cb(Fl_Widget *o, void *) {
+  Fl_Virtual_Scroll *s = (Fl_Virtual_Scroll*)(o->parent());
+  s->scroll_to(int(((Fl_Scrollbar*)o)->value()));
+}
+
+/**
+  Returns the bounding box for the interior of the list, inside the
+  scrollbar.
+*/
+void Fl_Virtual_Scroll::bbox(int &X, int &Y, int &W, int &H) {
+  X = x() + Fl::box_dx(box());
+  Y = y() + Fl::box_dy(box());
+  W = w() - Fl::box_dw(box());
+  H = h() - Fl::box_dh(box());
+  if (scrollbar.visible()) W -= scrollbar.w();
+}
+
+// Shows the scrollbar if needed, and makes sure the visible rows have a
+// widget bound to them, at the right place.
+void Fl_Virtual_Scroll::update_rows() {
+  int X = x() + Fl::box_dx(box());
+  int Y = y() + Fl::box_dy(box());
+  int W = w() - Fl::box_dw(box());
+  int H = h() - Fl::box_dh(box());
+  int total = rows_ * row_height_;
+  if (total > H) {
+    int size = scrollbar_size_ ? scrollbar_size_ : Fl::scrollbar_size();
+    W -= size;
+    scrollbar.resize(X + W, Y, size, H);
+    scrollbar.set_visible();
+  } else {
+    scrollbar.clear_visible();
+  }
+  if (yposition_ > total - H) yposition_ = total - H;
+  if (yposition_ < 0) yposition_ = 0;
+  scrollbar.value(yposition_, H, 0, total);
+  scrollbar.linesize(row_height_);
+
+  int first = yposition_ / row_height_;
+  int count = H / row_height_ + 2; // rows partly shown at the top and bottom
+  if (count > rows_ - first) count = rows_ - first;
+  if (count < 0) count = 0;
+
+  if (count > pool_) { // create more row widgets
+    pool_row_ = (int*)realloc(pool_row_, count * sizeof(int));
+    Fl_Group *g = Fl_Group::current();
+    Fl_Group::current(0);
+    while (pool_ < count) {
+      Fl_Widget *o = create_row();
+      if (!o) break;
+      insert(*o, pool_);
+      pool_row_[pool_++] = -1;
+    }
+    Fl_Group::current(g);
+    if (count > pool_) count = pool_;
+  }
+
+  for (int r = first; r < first + count; r++) {
+    int i = r % pool_;
+    Fl_Widget *o = child(i);
+    if (pool_row_[i] != r) {
+      pool_row_[i] = r;
+      bind_row(o, r);
+    }
+    o->resize(X, Y + r * row_height_ - yposition_, W, row_height_);
+    if (!o->visible()) o->show();
+  }
+  for (int i = 0; i < pool_; i++) {
+    int r = pool_row_[i];
+    if (r >= first && r < first + count && r % pool_ == i) continue;
+    if (child(i)->visible()) child(i)->hide();
+  }
+}
+
+void Fl_Virtual_Scroll::draw() {
+  int X, Y, W, H; bbox(X, Y, W, H);
+  if (damage() & ~FL_DAMAGE_CHILD) { // redraw the entire thing:
+    draw_box();
+    fl_push_clip(X, Y, W, H);
+    int B = Y + rows_ * row_height_ - yposition_;
+    if (B < Y + H) { // erase below the last row
+      fl_color(color());
+      fl_rectf(X, B, W, Y + H - B);
+    }
+    for (int i = 0; i < pool_; i++) draw_child(*child(i));
+    fl_pop_clip();
+    draw_child(scrollbar);
+  } else { // only redraw the children that need it:
+    fl_push_clip(X, Y, W, H);
+    for (int i = 0; i < pool_; i++) update_child(*child(i));
+    fl_pop_clip();
+    update_child(scrollbar);
+  }
+}
+
+/**
+  Resizes the list. The row widgets are resized to the new width, and
+  widgets are created if more rows are visible.
+*/
+void Fl_Virtual_Scroll::resize(int X, int Y, int W, int H) {
+  Fl_Widget::resize(X, Y, W, H);
+  update_rows();
+}
+
+/**
+  Creates a widget to show rows in.
+  The default calls the create function given to source(), if any.
+  \returns the new widget, or NULL if no widget can be created
+*/
+Fl_Widget *Fl_Virtual_Scroll::create_row() {
+  return create_ ? create_(source_data_) : 0;
+}
+
+/**
+  Shows the data of \p row in \p row_widget, which was created by
+  create_row() and may have shown another row before.
+  The default calls the bind function given to source(), if any.
+*/
+void Fl_Virtual_Scroll::bind_row(Fl_Widget *row_widget, int row) {
+  if (bind_) bind_(row_widget, row, source_data_);
+}
+
+/**
+  Sets the functions that create the row widgets and show the data of
+  a row in them. \p data is passed to both. The row widgets created by
+  the previous functions are deleted.
+*/
+void Fl_Virtual_Scroll::source(Fl_Virtual_Scroll_Create *c, Fl_Virtual_Scroll_Bind *b, void *data) {
+  create_ = c;
+  bind_ = b;
+  source_data_ = data;
+  while (pool_) {
+    Fl_Widget *o = child(--pool_);
+    remove(pool_);
+    delete o;
+  }
+  update_rows();
+  redraw();
+}
+
+/**
+  Sets the number of rows. The visible rows that still exist are not bound
+  again, call rebind() if their data changed.
+*/
+void Fl_Virtual_Scroll::rows(int n) {
+  if (n < 0) n = 0;
+  rows_ = n;
+  for (int i = 0; i < pool_; i++)
+    if (pool_row_[i] >= n) pool_row_[i] = -1;
+  update_rows();
+  redraw();
+}
+
+/**
+  Sets the height of all rows, in pixels. The first visible row stays at
+  the top of the list.
+*/
+void Fl_Virtual_Scroll::row_height(int h) {
+  if (h < 1) h = 1;
+  if (h == row_height_) return;
+  yposition_ = top_row() * h;
+  row_height_ = h;
+  update_rows();
+  redraw();
+}
+
+/**
+  Scrolls the list so that the point \p Y pixels below the top of the
+  first row is at the top. Only the rows that become visible are bound.
+*/
+void Fl_Virtual_Scroll::scroll_to(int Y) {
+  if (Y == yposition_) return;
+  yposition_ = Y;
+  update_rows();
+  redraw();
+}
+
+/** Scrolls the list as little as possible to make \p row fully visible. */
+void Fl_Virtual_Scroll::show_row(int row) {
+  if (row < 0 || row >= rows_) return;
+  int X, Y, W, H; bbox(X, Y, W, H);
+  int top = row * row_height_;
+  if (top < yposition_) scroll_to(top);
+  else if (top + row_height_ > yposition_ + H) scroll_to(top + row_height_ - H);
+}
+
+/** Returns the widget showing \p row, or NULL if the row is not visible. */
+Fl_Widget *Fl_Virtual_Scroll::row_widget(int row) const {
+  if (!pool_ || row < 0) return 0;
+  int i = row % pool_;
+  if (pool_row_[i] != row || !child(i)->visible()) return 0;
+  return child(i);
+}
+
+/** Binds the visible rows again, after their data changed. */
+void Fl_Virtual_Scroll::rebind() {
+  for (int i = 0; i < pool_; i++) pool_row_[i] = -1;
+  update_rows();
+  redraw();
+}
+
+//
+// End of "$Id$".
+//
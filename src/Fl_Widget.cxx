@@ -140,6 +140,10 @@ Fl_Widget::Fl_Widget(int X, int Y, int W, int H, const char* L) {
 
 void Fl_Widget::resize(int X, int Y, int W, int H) {
   x_ = X; y_ = Y; w_ = W; h_ = H;
+  if (parent_) {
+    parent_->set_flag(NEEDS_LAYOUT);
+    if (parent_->index_) parent_->child_resized_(this);
+  }
 }
 
 // this is useful for parent widgets to call to resize children:
@@ -240,6 +244,7 @@ int Fl_Widget::active_r() const {
 void Fl_Widget::show() {
   if (!visible()) {
     clear_flag(INVISIBLE);
+    if (parent_) parent_->set_flag(NEEDS_LAYOUT);
     if (visible_r()) {
       redraw();
       redraw_label();
@@ -250,6 +255,7 @@ void Fl_Widget::show() {
 }
 
 void Fl_Widget::hide() {
+  if (parent_ && visible()) parent_->set_flag(NEEDS_LAYOUT);
   if (visible_r()) {
     set_flag(INVISIBLE);
     for (Fl_Widget *p = parent(); p; p = p->parent())
@@ -20,6 +20,9 @@
 // Replaces the older set_idle() call (which is used to implement this)
 
 #include <FL/Fl.H>
+#include <FL/Fl_Profiler.H>
+#include <FL/Fl_Screen_Driver.H>
+#include <FL/Fl_System_Driver.H>
 
 struct idle_cb {
   void (*cb)(void*);
@@ -37,7 +40,10 @@ static idle_cb* freelist;
 static void call_idle() {
   idle_cb* p = first;
   last = p; first = p->next;
-  p->cb(p->data); // this may call add_idle() or remove_idle()!
+  Fl_Idle_Handler cb = p->cb;
+  double t0 = Fl_Profiler::start_();
+  cb(p->data); // this may call add_idle() or remove_idle()!
+  if (t0) Fl_Profiler::stop_(Fl_Profiler::IDLE, (Fl_Profiler::Function)cb, 0, t0);
 }
 
 /**
@@ -109,6 +115,139 @@ void Fl::remove_idle(Fl_Idle_Handler cb, void* data) {
   freelist = p;
 }
 
+////////////////////////////////////////////////////////////////
+// Idle tasks:
+
+struct idle_task {
+  Fl_Idle_Task task;
+  void* data;
+  int priority;
+  char removed; // removed while running, freed when it returns
+  idle_task *next;
+};
+
+// tasks sorted by decreasing priority, the next one to run first
+static idle_task* tasks;
+static idle_task* running;
+static double task_budget = 0.005;
+
+// inserts a task after the last one of the same or a higher priority
+static void insert_task(idle_task* t) {
+  idle_task** p = &tasks;
+  while (*p && (*p)->priority >= t->priority) p = &((*p)->next);
+  t->next = *p;
+  *p = t;
+}
+
+static void unlink_task(idle_task* t) {
+  for (idle_task** p = &tasks; *p; p = &((*p)->next))
+    if (*p == t) {*p = t->next; return;}
+}
+
+// The idle callback that runs the tasks until the budget is spent or
+// the user does something:
+static void run_idle_tasks(void*) {
+  double start = Fl::system_driver()->monotonic_clock();
+  double now = start, checked = start;
+  if (Fl::screen_driver()->input_pending()) return;
+  while (tasks) {
+    idle_task* t = running = tasks;
+    tasks = t->next;
+    Fl_Idle_Task task = t->task;
+    double t0 = Fl_Profiler::start_();
+    int more = task(t->data); // this may add or remove tasks!
+    if (t0) Fl_Profiler::stop_(Fl_Profiler::IDLE, (Fl_Profiler::Function)task, 0, t0);
+    running = 0;
+    if (t->removed || !more) delete t;
+    else insert_task(t); // after the tasks of the same priority
+    now = Fl::system_driver()->monotonic_clock();
+    if (now - start >= task_budget) break;
+    // looking at the event queue is not free, do it at most every ms:
+    if (now - checked >= 0.001) {
+      if (Fl::screen_driver()->input_pending()) break;
+      checked = now;
+    }
+  }
+  if (!tasks) Fl::remove_idle(run_idle_tasks);
+}
+
+/**
+  Adds a task that does background work in small steps.
+
+  Like idle callbacks, tasks are called by Fl::wait() when there is
+  nothing else to do, but they are scheduled:
+  - each step of work is a call of \p task that returns non-zero if there
+    is more work to do, or 0 when it is done, which removes the task;
+  - tasks with a higher \p priority run first, tasks of the same priority
+    take turns;
+  - each time the event loop is idle, tasks run until they have used
+    Fl::idle_budget() seconds, so that events are not delayed by more
+    than the budget and the length of one step;
+  - tasks do not run while mouse or keyboard events are waiting.
+
+  A step should take much less time than the budget. The task can keep
+  its state in \p data to resume where it stopped:
+
+  \code
+  int index_step(void *data) {
+    Indexer *ix = (Indexer*)data;
+    ix->index(ix->next_file++);
+    return ix->next_file < ix->num_files;
+  }
+  ...
+  Fl::add_idle_task(index_step, indexer);
+  \endcode
+
+  The same task and data can be added more than once.
+  \see Fl::remove_idle_task(), Fl::idle_budget(double)
+*/
+void Fl::add_idle_task(Fl_Idle_Task task, void* data, int priority) {
+  idle_task* t = new idle_task;
+  t->task = task;
+  t->data = data;
+  t->priority = priority;
+  t->removed = 0;
+  insert_task(t);
+  if (!has_idle(run_idle_tasks)) add_idle(run_idle_tasks);
+}
+
+/** Returns true if the specified idle task is currently installed. */
+int Fl::has_idle_task(Fl_Idle_Task task, void* data) {
+  for (idle_task* t = tasks; t; t = t->next)
+    if (t->task == task && t->data == data) return 1;
+  return running && !running->removed && running->task == task && running->data == data;
+}
+
+/** Removes the specified idle task, if it is installed. */
+void Fl::remove_idle_task(Fl_Idle_Task task, void* data) {
+  if (running && running->task == task && running->data == data && !running->removed) {
+    running->removed = 1;
+    return;
+  }
+  for (idle_task* t = tasks; t; t = t->next) {
+    if (t->task == task && t->data == data) {
+      unlink_task(t);
+      delete t;
+      break;
+    }
+  }
+  if (!tasks && !running) remove_idle(run_idle_tasks);
+}
+
+/**
+  Sets the time that idle tasks may use each time the event loop is idle,
+  in seconds. The default is 0.005 (5 ms).
+  \see Fl::add_idle_task()
+*/
+void Fl::idle_budget(double seconds) {
+  task_budget = seconds;
+}
+
+/** Returns the time that idle tasks may use each time the event loop is idle. */
+double Fl::idle_budget() {
+  return task_budget;
+}
+
 //
 // End of "$Id$".
 //
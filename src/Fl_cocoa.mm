@@ -78,6 +78,7 @@ extern "C" {
 extern void fl_fix_focus();
 extern unsigned short *fl_compute_macKeyLookUp();
 extern int fl_send_system_handlers(void *e);
+extern void fl_flush_frame();
 
 // forward definition of functions in this file
 // converting cr lf converter function
@@ -864,7 +865,7 @@ double Fl_Cocoa_Screen_Driver::wait(double time_to_wait)
     if (Fl::idle) time_to_wait = 0.0;
   }
   NSDisableScreenUpdates(); // 10.3 Makes updates to all windows appear as a single event
-  Fl::flush();
+  fl_flush_frame();
   NSEnableScreenUpdates(); // 10.3
   if (Fl::idle && !in_idle) // 'idle' may have been set within flush()
     time_to_wait = 0.0;
@@ -2970,6 +2971,7 @@ Fl_X* Fl_Cocoa_Window_Driver::makeWindow()
   Fl_X *x = new Fl_X;
   other_xid = 0; // room for doublebuffering image map. On OS X this is only used by overlay windows
   x->region = 0;
+  x->damage_rects = 0;
   subRect(0);
   gc = 0;
   mapped_to_retina(false);
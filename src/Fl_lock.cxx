@@ -19,6 +19,7 @@
 #include "config_lib.h"
 #include <FL/Fl.H>
 #include <FL/Fl_System_Driver.H>
+#include <FL/Fl_Profiler.H>
 
 #include <stdlib.h>
 
@@ -66,67 +67,194 @@
    returns the most recent value!
 */
 
-#ifndef FL_DOXYGEN
-Fl_Awake_Handler *Fl::awake_ring_;
-void **Fl::awake_data_;
-int Fl::awake_ring_size_;
-int Fl::awake_ring_head_;
-int Fl::awake_ring_tail_;
+/*
+   The awake queue is a lock-free, unbounded, multiple-producer
+   single-consumer queue (Dmitry Vyukov's intrusive MPSC queue).
+   Any thread can post a handler with a single atomic exchange, and
+   only the main thread takes handlers out of the queue, so no lock
+   is needed and no handler is lost because the queue is full.
+
+   awake_count counts the handlers posted but not yet taken out. The
+   main thread is only woken up by the post that finds it zero, so a
+   burst of posts costs a single system call.
+*/
+
+struct Fl_Awake_Node {
+  Fl_Awake_Handler func;
+  void *data;
+  Fl_Awake_Node *volatile next;
+  Fl_Awake_Node *next_once;   // next in awake_once_table chain, see Fl::awake_once()
+  char once;                  // node is in awake_once_table
+};
+
+static Fl_Awake_Node awake_stub;                          // always in the queue when it is empty
+static Fl_Awake_Node *volatile awake_head = &awake_stub;  // last posted node (producers)
+static Fl_Awake_Node *awake_tail = &awake_stub;           // next node to take out (main thread)
+static volatile long awake_count;                         // handlers posted minus handlers taken out
+
+#if defined(_MSC_VER)
+#  include <windows.h>
+static inline Fl_Awake_Node *atomic_exchange(Fl_Awake_Node *volatile *p, Fl_Awake_Node *v) {
+  return (Fl_Awake_Node*)InterlockedExchangePointer((PVOID volatile*)p, v);
+}
+static inline Fl_Awake_Node *atomic_load(Fl_Awake_Node *volatile *p) {
+  return (Fl_Awake_Node*)InterlockedCompareExchangePointer((PVOID volatile*)p, 0, 0);
+}
+static inline void atomic_store(Fl_Awake_Node *volatile *p, Fl_Awake_Node *v) {
+  InterlockedExchangePointer((PVOID volatile*)p, v);
+}
+static inline long atomic_add(volatile long *p, long v) { // returns the previous value
+  return InterlockedExchangeAdd(p, v);
+}
+#elif defined(__ATOMIC_ACQ_REL)
+static inline Fl_Awake_Node *atomic_exchange(Fl_Awake_Node *volatile *p, Fl_Awake_Node *v) {
+  return __atomic_exchange_n(p, v, __ATOMIC_ACQ_REL);
+}
+static inline Fl_Awake_Node *atomic_load(Fl_Awake_Node *volatile *p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static inline void atomic_store(Fl_Awake_Node *volatile *p, Fl_Awake_Node *v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+static inline long atomic_add(volatile long *p, long v) { // returns the previous value
+  return __atomic_fetch_add(p, v, __ATOMIC_ACQ_REL);
+}
+#else // older gcc
+static inline Fl_Awake_Node *atomic_exchange(Fl_Awake_Node *volatile *p, Fl_Awake_Node *v) {
+  __sync_synchronize();
+  return __sync_lock_test_and_set(p, v);
+}
+static inline Fl_Awake_Node *atomic_load(Fl_Awake_Node *volatile *p) {
+  Fl_Awake_Node *v = *p;
+  __sync_synchronize();
+  return v;
+}
+static inline void atomic_store(Fl_Awake_Node *volatile *p, Fl_Awake_Node *v) {
+  __sync_synchronize();
+  *p = v;
+}
+static inline long atomic_add(volatile long *p, long v) { // returns the previous value
+  return __sync_fetch_and_add(p, v);
+}
 #endif
 
-static const int AWAKE_RING_SIZE = 1024;
-static void lock_ring();
-static void unlock_ring();
+static void awake_push(Fl_Awake_Node *node) {
+  node->next = 0;
+  Fl_Awake_Node *prev = atomic_exchange(&awake_head, node);
+  atomic_store(&prev->next, node);
+}
 
-/** Adds an awake handler for use in awake(). */
-int Fl::add_awake_handler_(Fl_Awake_Handler func, void *data)
-{
-  int ret = 0;
-  lock_ring();
-  if (!awake_ring_) {
-    awake_ring_size_ = AWAKE_RING_SIZE;
-    awake_ring_ = (Fl_Awake_Handler*)malloc(awake_ring_size_*sizeof(Fl_Awake_Handler));
-    awake_data_ = (void**)malloc(awake_ring_size_*sizeof(void*));
-    // explicitly initialize the head and tail indices
-    awake_ring_head_= awake_ring_tail_ = 0;
+// Takes the oldest node out of the queue, returns NULL if the queue is
+// empty or if the next node is still being linked in by another thread.
+static Fl_Awake_Node *awake_pop() {
+  Fl_Awake_Node *tail = awake_tail;
+  Fl_Awake_Node *next = atomic_load(&tail->next);
+  if (tail == &awake_stub) {
+    if (!next) return 0;
+    awake_tail = tail = next;
+    next = atomic_load(&next->next);
   }
-  // The next head index we will want (not the current index):
-  // We use this to check if the ring-buffer is full or not
-  // (and to update awake_ring_head_ if we do use the current index.)
-  int next_head = awake_ring_head_ + 1;
-  if (next_head >= awake_ring_size_) {
-    next_head = 0;
+  if (!next) {
+    if (tail != atomic_load(&awake_head)) return 0;
+    awake_push(&awake_stub);
+    next = atomic_load(&tail->next);
+    if (!next) return 0;
   }
-  // check that the ring buffer is not full, and that it exists
-  if ((!awake_ring_) || (next_head == awake_ring_tail_)) {
-    // ring is non-existent or full. Return -1 as an error indicator.
-    ret = -1;
-  } else {
-    awake_ring_[awake_ring_head_] = func;
-    awake_data_[awake_ring_head_] = data;
-    awake_ring_head_ = next_head;
+  awake_tail = next;
+  return tail;
+}
+
+// Returns 1 if the main thread must be woken up, and 0 if a wakeup
+// is already pending.
+static int post_awake_node(Fl_Awake_Node *node)
+{
+  awake_push(node);
+  return atomic_add(&awake_count, 1) == 0;
+}
+
+// Same, or -1 if out of memory.
+static int post_awake_handler(Fl_Awake_Handler func, void *data)
+{
+  Fl_Awake_Node *node = (Fl_Awake_Node*)malloc(sizeof(Fl_Awake_Node));
+  if (!node) return -1;
+  node->func = func;
+  node->data = data;
+  node->once = 0;
+  return post_awake_node(node);
+}
+
+/*
+   Handlers posted with Fl::awake_once() are also linked in a hash
+   table keyed by (func, data) for as long as they are queued, so that
+   posting the same pair again can be detected and dropped. The table
+   is protected by lock_once(), which is only taken by awake_once()
+   and when such a handler is taken out of the queue.
+*/
+
+static Fl_Awake_Node **awake_once_table;
+static int awake_once_size;   // always a power of 2
+static int awake_once_count;
+static void lock_once();
+static void unlock_once();
+
+static inline unsigned awake_once_hash(Fl_Awake_Handler func, void *data) {
+  fl_uintptr_t h = (fl_uintptr_t)func * 31 + (fl_uintptr_t)data;
+  h ^= h >> 16;
+  h *= 0x45d9f3b;
+  h ^= h >> 16;
+  return (unsigned)h;
+}
+
+// must be called with lock_once() held
+static void awake_once_resize(int size) {
+  Fl_Awake_Node **table = (Fl_Awake_Node**)calloc(size, sizeof(Fl_Awake_Node*));
+  if (!table) return;
+  for (int i = 0; i < awake_once_size; i++) {
+    Fl_Awake_Node *node = awake_once_table[i];
+    while (node) {
+      Fl_Awake_Node *next = node->next_once;
+      unsigned h = awake_once_hash(node->func, node->data) & (size-1);
+      node->next_once = table[h];
+      table[h] = node;
+      node = next;
+    }
+  }
+  free(awake_once_table);
+  awake_once_table = table;
+  awake_once_size = size;
+}
+
+// Removes a node taken out of the queue from awake_once_table.
+static void awake_once_remove(Fl_Awake_Node *node) {
+  lock_once();
+  unsigned h = awake_once_hash(node->func, node->data) & (awake_once_size-1);
+  Fl_Awake_Node **p = awake_once_table + h;
+  while (*p && *p != node) p = &((*p)->next_once);
+  if (*p) {
+    *p = node->next_once;
+    awake_once_count--;
   }
-  unlock_ring();
-  return ret;
+  unlock_once();
+}
+
+/** Adds an awake handler for use in awake(). */
+int Fl::add_awake_handler_(Fl_Awake_Handler func, void *data)
+{
+  return post_awake_handler(func, data) < 0 ? -1 : 0;
 }
 
 /** Gets the last stored awake handler for use in awake(). */
 int Fl::get_awake_handler_(Fl_Awake_Handler &func, void *&data)
 {
-  int ret = 0;
-  lock_ring();
-  if ((!awake_ring_) || (awake_ring_head_ == awake_ring_tail_)) {
-    ret = -1;
-  } else {
-    func = awake_ring_[awake_ring_tail_];
-    data = awake_data_[awake_ring_tail_];
-    ++awake_ring_tail_;
-    if (awake_ring_tail_ >= awake_ring_size_) {
-      awake_ring_tail_ = 0;
-    }
-  }
-  unlock_ring();
-  return ret;
+  Fl_Awake_Node *node = awake_pop();
+  if (!node) return -1;
+  // remove it before it is called, so that it can be posted again:
+  if (node->once) awake_once_remove(node);
+  func = node->func;
+  data = node->data;
+  free(node);
+  atomic_add(&awake_count, -1);
+  return 0;
 }
 
 /**
@@ -134,15 +262,68 @@ int Fl::get_awake_handler_(Fl_Awake_Handler &func, void *&data)
  Registers a function that will be 
  called by the main thread during the next message handling cycle. 
  Returns 0 if the callback function was registered, 
- and -1 if registration failed. Over a thousand awake callbacks can be
- registered simultaneously.
+ and -1 if registration failed because memory could not be allocated.
+ There is no limit to the number of awake callbacks that can be
+ registered simultaneously, and a burst of registrations wakes up
+ the main thread only once.
  
  \see Fl::awake(void* message=0)
 */
 int Fl::awake(Fl_Awake_Handler func, void *data) {
-  int ret = add_awake_handler_(func, data);
-  Fl::awake();
-  return ret;
+  int ret = post_awake_handler(func, data);
+  if (ret < 0) return -1;
+  if (ret) Fl::awake();
+  return 0;
+}
+
+/**
+ Let the main thread call a function, unless the same call is already pending.
+ Works like Fl::awake(Fl_Awake_Handler, void*), but if an earlier call
+ with the same \p func and \p data posted by awake_once() has not been
+ done yet, nothing is added: the pending call will be done only once.
+
+ This is meant for threads that post the same update many times between
+ two redraws, for instance "refresh the progress bar" or "redraw the plot":
+ the handler reads the current state through \p data when it is called,
+ so the latest value is always shown and the main thread does the work
+ once per cycle instead of once per post.
+
+ \return 0 if the callback was registered, 1 if it was merged with a
+	pending identical call, and -1 if registration failed.
+
+ \see Fl::awake(Fl_Awake_Handler, void*)
+*/
+int Fl::awake_once(Fl_Awake_Handler func, void *data) {
+  lock_once();
+  if (awake_once_count >= awake_once_size)
+    awake_once_resize(awake_once_size ? 2*awake_once_size : 32);
+  if (!awake_once_table) {
+    unlock_once();
+    return -1;
+  }
+  unsigned h = awake_once_hash(func, data) & (awake_once_size-1);
+  for (Fl_Awake_Node *node = awake_once_table[h]; node; node = node->next_once) {
+    if (node->func == func && node->data == data) {
+      unlock_once();
+      return 1;
+    }
+  }
+  Fl_Awake_Node *node = (Fl_Awake_Node*)malloc(sizeof(Fl_Awake_Node));
+  if (!node) {
+    unlock_once();
+    return -1;
+  }
+  node->func = func;
+  node->data = data;
+  node->once = 1;
+  node->next_once = awake_once_table[h];
+  awake_once_table[h] = node;
+  awake_once_count++;
+  // post while locked, so the node cannot be taken out and freed before:
+  int ret = post_awake_node(node);
+  unlock_once();
+  if (ret) Fl::awake();
+  return 0;
 }
 
 /** \fn int Fl::lock()
@@ -210,18 +391,18 @@ static DWORD main_thread;
 
 // Microsoft's version of a MUTEX...
 CRITICAL_SECTION cs;
-CRITICAL_SECTION *cs_ring;
+CRITICAL_SECTION *cs_once;
 
-void unlock_ring() {
-  LeaveCriticalSection(cs_ring);
+static void unlock_once() {
+  LeaveCriticalSection(cs_once);
 }
 
-void lock_ring() {
-  if (!cs_ring) {
-    cs_ring = (CRITICAL_SECTION*)malloc(sizeof(CRITICAL_SECTION));
-    InitializeCriticalSection(cs_ring);
+static void lock_once() {
+  if (!cs_once) {
+    cs_once = (CRITICAL_SECTION*)malloc(sizeof(CRITICAL_SECTION));
+    InitializeCriticalSection(cs_once);
   }
-  EnterCriticalSection(cs_ring);
+  EnterCriticalSection(cs_once);
 }
 
 //
@@ -336,8 +517,13 @@ static void thread_awake_cb(int fd, void*) {
   Fl_Awake_Handler func;
   void *data;
   while (Fl::get_awake_handler_(func, data)==0) {
+    double t0 = Fl_Profiler::start_();
     (*func)(data);
+    if (t0) Fl_Profiler::stop_(Fl_Profiler::AWAKE, (Fl_Profiler::Function)func, 0, t0);
   }
+  // a handler may still be in the middle of being posted by another
+  // thread, which will not wake us up again, so look again soon:
+  if (atomic_add(&awake_count, 0) > 0) Fl::awake();
 }
 
 // These pointers are in Fl_x.cxx:
@@ -386,19 +572,15 @@ void Fl_Posix_System_Driver::unlock() {
   fl_unlock_function();
 }
 
-// Mutex code for the awake ring buffer
-static pthread_mutex_t *ring_mutex;
+// Mutex for the Fl::awake_once() table
+static pthread_mutex_t once_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-void unlock_ring() {
-  pthread_mutex_unlock(ring_mutex);
+static void unlock_once() {
+  pthread_mutex_unlock(&once_mutex);
 }
 
-void lock_ring() {
-  if (!ring_mutex) {
-    ring_mutex = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
-    pthread_mutex_init(ring_mutex, NULL);
-  }
-  pthread_mutex_lock(ring_mutex);
+static void lock_once() {
+  pthread_mutex_lock(&once_mutex);
 }
 
 #else // ! HAVE_PTHREAD
@@ -408,8 +590,8 @@ int Fl_Posix_System_Driver::lock() { return 1; }
 void Fl_Posix_System_Driver::unlock() {}
 void* Fl_Posix_System_Driver::thread_message() { return NULL; }
 
-void lock_ring() {}
-void unlock_ring() {}
+static void lock_once() {}
+static void unlock_once() {}
 
 #endif // HAVE_PTHREAD
 
@@ -55,6 +55,7 @@ void fl_cleanup_dc_list(void);
 #include <FL/Fl_Window_Driver.H>
 #include <FL/Fl_Screen_Driver.H>
 #include <FL/Fl_Graphics_Driver.H>     // for fl_graphics_driver
+#include <FL/Fl_Profiler.H>
 #include "drivers/WinAPI/Fl_WinAPI_Window_Driver.H"
 #include "drivers/WinAPI/Fl_WinAPI_System_Driver.H"
 #include "drivers/WinAPI/Fl_WinAPI_Screen_Driver.H"
@@ -358,6 +359,7 @@ void* Fl_WinAPI_System_Driver::thread_message() {
 }
 
 extern int fl_send_system_handlers(void *e);
+extern void fl_flush_frame(); // in Fl.cxx
 
 MSG fl_msg;
 
@@ -367,7 +369,9 @@ static void process_awake_handler_requests(void) {
   Fl_Awake_Handler func;
   void *data;
   while (Fl::get_awake_handler_(func, data) == 0) {
+    double t0 = Fl_Profiler::start_();
     func(data);
+    if (t0) Fl_Profiler::stop_(Fl_Profiler::AWAKE, (Fl_Profiler::Function)func, 0, t0);
   }
 }
 
@@ -451,31 +455,22 @@ double Fl_WinAPI_Screen_Driver::wait(double time_to_wait) {
     DispatchMessageW(&fl_msg);
   }
 
-  // The following conditional test:
-  //    (Fl::awake_ring_head_ != Fl::awake_ring_tail_)
-  // is a workaround / fix for STR #3143. This works, but a better solution
-  // would be to understand why the PostThreadMessage() messages are not
-  // seen by the main window if it is being dragged/ resized at the time.
-  // If a worker thread posts an awake callback to the ring buffer
+  // The following call is a workaround / fix for STR #3143. This works,
+  // but a better solution would be to understand why the PostThreadMessage()
+  // messages are not seen by the main window if it is being dragged/ resized
+  // at the time. If a worker thread posts an awake callback to the queue
   // whilst the main window is unresponsive (if a drag or resize operation
-  // is in progress) we may miss the PostThreadMessage(). So here, we check if
-  // there is anything pending in the awake ring buffer and if so process
-  // it. This is not strictly thread safe (for speed it compares the head
-  // and tail indices without first locking the ring buffer) but is intended
-  // only as a fall-back recovery mechanism if the awake processing stalls.
-  // If the test erroneously returns true (may happen if we test the indices
-  // whilst they are being modified) we will call process_awake_handler_requests()
-  // unnecessarily, but this has no harmful consequences so is safe to do.
+  // is in progress) we may miss the PostThreadMessage(). So here, we process
+  // anything pending in the awake queue. This is cheap when the queue is
+  // empty. Since only the first of a burst of awake callbacks posts a
+  // message, this also recovers callbacks that would otherwise wait for
+  // the next message.
   // Note also that if we miss the PostThreadMessage(), then thread_message_
   // will not be updated, so this is not a perfect solution, but it does
-  // recover and process any pending awake callbacks.
-  // Normally the ring buffer head and tail indices will match and this
-  // comparison will do nothing. Addresses STR #3143
-  if (Fl::awake_ring_head_ != Fl::awake_ring_tail_) {
-    process_awake_handler_requests();
-  }
+  // recover and process any pending awake callbacks. Addresses STR #3143
+  process_awake_handler_requests();
 
-  Fl::flush();
+  fl_flush_frame();
 
   // This should return 0 if only timer events were handled:
   return 1;
@@ -493,6 +488,10 @@ int Fl_WinAPI_Screen_Driver::ready() {
   return get_wsock_mod() ? s_wsock_select(0,&fdt[0],&fdt[1],&fdt[2],&t) : 0;
 }
 
+int Fl_WinAPI_Screen_Driver::input_pending() {
+  return HIWORD(GetQueueStatus(QS_INPUT)) != 0;
+}
+
 //extern FILE*LOG;
 
 void Fl_WinAPI_Screen_Driver::open_display_platform() {
@@ -1163,6 +1162,7 @@ static LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPar
     if (!i->region && window->damage()) {
       // Redraw the whole window...
       i->region = CreateRectRgn(0, 0, window->w(), window->h());
+      i->damage_rects = 0;
       redraw_whole_window = true;
     }
 
@@ -1191,6 +1191,7 @@ static LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPar
     
     // convert R2 in drawing units to i->region in FLTK units
     i->region = Fl_GDI_Graphics_Driver::scale_region(R2, 1/scale, NULL);
+    i->damage_rects = 0; // the region now includes WIN32's damage
 
     window->clear_damage((uchar)(window->damage()|FL_DAMAGE_EXPOSE));
     // These next two statements should not be here, so that all update
@@ -1941,6 +1942,7 @@ Fl_X* Fl_WinAPI_Window_Driver::makeWindow() {
   x->w = w;
   i(x);
   x->region = 0;
+  x->damage_rects = 0;
   Fl_WinAPI_Window_Driver::driver(w)->private_dc = 0;
   cursor = LoadCursor(NULL, IDC_ARROW);
   custom_cursor = 0;
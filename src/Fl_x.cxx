@@ -29,6 +29,8 @@
 #  include <FL/Fl_Window.H>
 #  include <FL/fl_utf8.h>
 #  include <FL/Fl_Tooltip.H>
+#  include <FL/Fl_Profiler.H>
+#  include <FL/Fl_Input_Trace.H>
 #  include <FL/fl_draw.H>
 #  include <FL/Fl_Paged_Device.H>
 #  include <FL/Fl_Shared_Image.H>
@@ -78,9 +80,103 @@ static bool have_xfixes = false;
 extern Fl_Widget *fl_selection_requestor;
 
 ////////////////////////////////////////////////////////////////
-// interface to poll/select call:
+// interface to epoll/poll/select call:
 
-#  if USE_POLL
+#  if USE_EPOLL
+
+// epoll replaces poll() if both are configured:
+#    undef USE_POLL
+#    define USE_POLL 0
+
+#    include <sys/epoll.h>
+#    include <errno.h>
+#    define POLLIN 1
+#    define POLLOUT 4
+#    define POLLERR 8
+
+// The descriptors are registered with the kernel once, and the handlers
+// are stored in an array indexed by the descriptor itself, so adding and
+// removing a descriptor are O(1) and Fl::wait() only visits the ready ones.
+// There is one handler per condition (read, write, except).
+static const int fd_when[3] = { POLLIN, POLLOUT, POLLERR };
+static const unsigned fd_epoll_when[3] = { EPOLLIN, EPOLLOUT, EPOLLPRI };
+
+struct FD {
+  short events;   // POLLIN, POLLOUT, POLLERR, 0 if not registered
+  char edge;      // registered with EPOLLET
+  void (*cb[3])(int, void*);
+  void* arg[3];
+};
+
+static int nfds = 0;            // number of registered descriptors
+static int fd_array_size = 0;   // highest registered descriptor + 1, or more
+static FD *fd = 0;
+
+static int epoll_fd = -1;
+static epoll_event *epoll_events = 0;
+static int epoll_events_size = 0;
+static int epoll_pending = 0;   // events fetched by poll_or_select(), not dispatched yet
+
+static bool epoll_open() {
+  if (epoll_fd < 0) epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  return epoll_fd >= 0;
+}
+
+// Tells the kernel about the conditions now watched on descriptor n.
+static void epoll_update(int n, int had_events) {
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.data.fd = n;
+  for (int b = 0; b < 3; b++)
+    if (fd[n].events & fd_when[b]) ev.events |= fd_epoll_when[b];
+  if (fd[n].edge) ev.events |= EPOLLET;
+  if (!fd[n].events) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, n, &ev);
+  } else if (epoll_ctl(epoll_fd, had_events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, n, &ev) < 0) {
+    // the descriptor may have been closed and reused without remove_fd():
+    if (errno == ENOENT) epoll_ctl(epoll_fd, EPOLL_CTL_ADD, n, &ev);
+    else if (errno == EEXIST) epoll_ctl(epoll_fd, EPOLL_CTL_MOD, n, &ev);
+  }
+}
+
+void Fl_X11_System_Driver::add_fd(int n, int events, void (*cb)(int, void*), void *v) {
+  if (n < 0 || !epoll_open()) return;
+  if (n >= fd_array_size) {
+    int size = 2*fd_array_size+1;
+    if (size <= n) size = n+1;
+    FD *temp = (FD*)realloc(fd, size*sizeof(FD));
+    if (!temp) return;
+    memset(temp+fd_array_size, 0, (size-fd_array_size)*sizeof(FD));
+    fd = temp;
+    fd_array_size = size;
+  }
+  int had_events = fd[n].events;
+  if (!had_events) {
+    fd[n].edge = 0;
+    nfds++;
+  }
+  if (events & FL_EDGE_TRIGGERED) fd[n].edge = 1;
+  for (int b = 0; b < 3; b++) {
+    if (events & fd_when[b]) {
+      fd[n].events |= fd_when[b];
+      fd[n].cb[b] = cb;
+      fd[n].arg[b] = v;
+    }
+  }
+  if (!fd[n].events) nfds--; // no known condition was given
+  else epoll_update(n, had_events);
+}
+
+void Fl_X11_System_Driver::remove_fd(int n, int events) {
+  if (n < 0 || n >= fd_array_size || !fd[n].events) return;
+  int had_events = fd[n].events;
+  fd[n].events &= ~events;
+  if (fd[n].events == had_events) return;
+  if (!fd[n].events) nfds--;
+  epoll_update(n, had_events);
+}
+
+#  elif USE_POLL
 
 #    include <poll.h>
 static pollfd *pollfds = 0;
@@ -99,8 +195,9 @@ static int maxfd;
 #    define POLLOUT 4
 #    define POLLERR 8
 
-#  endif /* USE_POLL */
+#  endif /* USE_EPOLL / USE_POLL */
 
+#  if !USE_EPOLL
 static int nfds = 0;
 static int fd_array_size = 0;
 struct FD {
@@ -115,6 +212,7 @@ struct FD {
 static FD *fd = 0;
 
 void Fl_X11_System_Driver::add_fd(int n, int events, void (*cb)(int, void*), void *v) {
+  events &= ~FL_EDGE_TRIGGERED; // only meaningful with epoll
   remove_fd(n,events);
   int i = nfds++;
   if (i >= fd_array_size) {
@@ -152,10 +250,6 @@ void Fl_X11_System_Driver::add_fd(int n, int events, void (*cb)(int, void*), voi
 #  endif
 }
 
-void Fl_X11_System_Driver::add_fd(int n, void (*cb)(int, void*), void* v) {
-  add_fd(n, POLLIN, cb, v);
-}
-
 void Fl_X11_System_Driver::remove_fd(int n, int events) {
   int i,j;
 # if !USE_POLL
@@ -193,6 +287,12 @@ void Fl_X11_System_Driver::remove_fd(int n, int events) {
 #  endif
 }
 
+#  endif /* !USE_EPOLL */
+
+void Fl_X11_System_Driver::add_fd(int n, void (*cb)(int, void*), void* v) {
+  add_fd(n, POLLIN, cb, v);
+}
+
 void Fl_X11_System_Driver::remove_fd(int n) {
   remove_fd(n, -1);
 }
@@ -204,14 +304,55 @@ static Fl_Window* send_motion;
 extern Fl_Window* fl_xmousewin;
 #endif
 static bool in_a_window; // true if in any of our windows, even destroyed ones
+
+// Returns true if the next queued event replaces this one, according
+// to Fl::event_compression(). Only consecutive events are merged, so
+// the order of events is kept.
+static bool event_is_stale(const XEvent &xevent) {
+  if (xevent.type == MotionNotify) {
+    if (!(Fl::event_compression() & FL_COMPRESS_MOTION)) return false;
+  } else if (xevent.type == ConfigureNotify) {
+    if (!(Fl::event_compression() & FL_COMPRESS_CONFIGURE)) return false;
+  } else return false;
+  if (!XEventsQueued(fl_display, QueuedAfterReading)) return false;
+  XEvent next;
+  XPeekEvent(fl_display, &next);
+  if (next.type != xevent.type) return false;
+  if (xevent.type == MotionNotify)
+    return next.xmotion.window == xevent.xmotion.window &&
+           next.xmotion.state == xevent.xmotion.state;
+  return next.xconfigure.window == xevent.xconfigure.window &&
+         next.xconfigure.event == xevent.xconfigure.event;
+}
+
 static void do_queued_events() {
   in_a_window = true;
   while (XEventsQueued(fl_display,QueuedAfterReading)) {
     XEvent xevent;
     XNextEvent(fl_display, &xevent);
-    if (fl_send_system_handlers(&xevent))
+    if (event_is_stale(xevent))
       continue;
-    fl_handle(xevent);
+    if (Fl_Input_Trace::enabled()) {
+      switch (xevent.type) {
+        case KeyPress: case KeyRelease:
+        case ButtonPress: case ButtonRelease: case MotionNotify:
+          // these events all have their time at the same place:
+          Fl_Input_Trace::arrival_(xevent.xkey.time);
+          break;
+      }
+    }
+    double t0 = Fl_Profiler::start_();
+    if (!fl_send_system_handlers(&xevent))
+      fl_handle(xevent);
+    if (t0) Fl_Profiler::stop_(Fl_Profiler::EVENT, 0, 0, t0);
+    if (Fl_Input_Trace::enabled()) {
+      // a filtered or already handled event must not stamp the next one,
+      // but a motion left for later keeps its arrival for the FL_MOVE below
+#if CONSOLIDATE_MOTION
+      if (!send_motion)
+#endif
+        Fl_Input_Trace::discard_();
+    }
   }
   // we send FL_LEAVE only if the mouse did not enter some other window:
   if (!in_a_window) Fl::handle(FL_LEAVE, 0);
@@ -221,6 +362,7 @@ static void do_queued_events() {
     Fl::handle(FL_MOVE, fl_xmousewin);
   }
 #endif
+  if (Fl_Input_Trace::enabled()) Fl_Input_Trace::discard_();
 }
 
 // these pointers are set by the Fl::lock() function:
@@ -238,7 +380,18 @@ int Fl_X11_Screen_Driver::poll_or_select_with_delay(double time_to_wait) {
   // so we must check for already-read events:
   if (fl_display && XQLength(fl_display)) {do_queued_events(); return 1;}
 
-#  if !USE_POLL
+#  if USE_EPOLL
+  if (!epoll_open()) return -1;
+  // at most 1024 ready descriptors are handled per call, the others
+  // are reported again by the next call:
+  int maxevents = nfds < 1 ? 1 : (nfds < 1024 ? nfds : 1024);
+  if (epoll_events_size < maxevents) {
+    epoll_event *temp = (epoll_event*)realloc(epoll_events, maxevents*sizeof(epoll_event));
+    if (!temp) return -1;
+    epoll_events = temp;
+    epoll_events_size = maxevents;
+  }
+#  elif !USE_POLL
   fd_set fdt[3];
   fdt[0] = fdsets[0];
   fdt[1] = fdsets[1];
@@ -246,10 +399,19 @@ int Fl_X11_Screen_Driver::poll_or_select_with_delay(double time_to_wait) {
 #  endif
   int n;
 
+#  if USE_EPOLL
+  if (epoll_pending) {
+    // events were already fetched by poll_or_select()
+    n = epoll_pending;
+    epoll_pending = 0;
+  } else {
+#  endif
   fl_unlock_function();
 
   if (time_to_wait < 2147483.648) {
-#  if USE_POLL
+#  if USE_EPOLL
+    n = ::epoll_wait(epoll_fd, epoll_events, maxevents, int(time_to_wait*1000 + .5));
+#  elif USE_POLL
     n = ::poll(pollfds, nfds, int(time_to_wait*1000 + .5));
 #  else
     timeval t;
@@ -258,7 +420,9 @@ int Fl_X11_Screen_Driver::poll_or_select_with_delay(double time_to_wait) {
     n = ::select(maxfd+1,&fdt[0],&fdt[1],&fdt[2],&t);
 #  endif
   } else {
-#  if USE_POLL
+#  if USE_EPOLL
+    n = ::epoll_wait(epoll_fd, epoll_events, maxevents, -1);
+#  elif USE_POLL
     n = ::poll(pollfds, nfds, -1);
 #  else
     n = ::select(maxfd+1,&fdt[0],&fdt[1],&fdt[2],0);
@@ -266,21 +430,55 @@ int Fl_X11_Screen_Driver::poll_or_select_with_delay(double time_to_wait) {
   }
 
   fl_lock_function();
+#  if USE_EPOLL
+  }
+#  endif
 
+#  if USE_EPOLL
+  for (int k = 0; k < n; k++) {
+    int f = epoll_events[k].data.fd;
+    unsigned revents = epoll_events[k].events;
+    // call each distinct handler at most once, and look the descriptor up
+    // again after each callback, which may have changed the handlers:
+    void (*done_cb[3])(int, void*);
+    void *done_arg[3];
+    int ndone = 0;
+    for (int b = 0; b < 3; b++) {
+      if (f >= fd_array_size || !(fd[f].events & fd_when[b])) continue;
+      if (!(revents & (fd_epoll_when[b] | EPOLLERR | EPOLLHUP))) continue;
+      void (*cb)(int, void*) = fd[f].cb[b];
+      void *arg = fd[f].arg[b];
+      int c;
+      for (c = 0; c < ndone; c++) if (done_cb[c] == cb && done_arg[c] == arg) break;
+      if (c < ndone) continue;
+      done_cb[ndone] = cb;
+      done_arg[ndone++] = arg;
+      double t0 = Fl_Profiler::start_();
+      cb(f, arg);
+      if (t0) Fl_Profiler::stop_(Fl_Profiler::FD, (Fl_Profiler::Function)cb, 0, t0);
+    }
+  }
+#  else
   if (n > 0) {
     for (int i=0; i<nfds; i++) {
-#  if USE_POLL
-      if (pollfds[i].revents) fd[i].cb(pollfds[i].fd, fd[i].arg);
-#  else
+#    if USE_POLL
+      if (!pollfds[i].revents) continue;
+      int f = pollfds[i].fd;
+#    else
       int f = fd[i].fd;
       short revents = 0;
       if (FD_ISSET(f,&fdt[0])) revents |= POLLIN;
       if (FD_ISSET(f,&fdt[1])) revents |= POLLOUT;
       if (FD_ISSET(f,&fdt[2])) revents |= POLLERR;
-      if (fd[i].events & revents) fd[i].cb(f, fd[i].arg);
-#  endif
+      if (!(fd[i].events & revents)) continue;
+#    endif
+      void (*cb)(int, void*) = fd[i].cb;
+      double t0 = Fl_Profiler::start_();
+      cb(f, fd[i].arg);
+      if (t0) Fl_Profiler::stop_(Fl_Profiler::FD, (Fl_Profiler::Function)cb, 0, t0);
     }
   }
+#  endif
   return n;
 }
 
@@ -288,7 +486,16 @@ int Fl_X11_Screen_Driver::poll_or_select_with_delay(double time_to_wait) {
 int Fl_X11_Screen_Driver::poll_or_select() {
   if (XQLength(fl_display)) return 1;
   if (!nfds) return 0; // nothing to select or poll
-#  if USE_POLL
+#  if USE_EPOLL
+  // keep the events for the next poll_or_select_with_delay(), because
+  // edge-triggered descriptors would not report them again:
+  if (!epoll_pending && epoll_events_size) {
+    int n = ::epoll_wait(epoll_fd, epoll_events, epoll_events_size, 0);
+    if (n < 0) return n;
+    epoll_pending = n;
+  }
+  return epoll_pending;
+#  elif USE_POLL
   return ::poll(pollfds, nfds, 0);
 #  else
   timeval t;
@@ -1951,15 +2158,16 @@ int fl_handle(const XEvent& thisevent)
   case MotionNotify:
     set_event_xy(window);
 #  if CONSOLIDATE_MOTION
-    send_motion = fl_xmousewin = window;
-    in_a_window = true;
-    return 0;
-#  else
+    if (Fl::event_compression() & FL_COMPRESS_MOTION) {
+      send_motion = fl_xmousewin = window;
+      in_a_window = true;
+      return 0;
+    }
+#  endif
     event = FL_MOVE;
     fl_xmousewin = window;
     in_a_window = true;
     break;
-#  endif
 
   case ButtonRelease:
     Fl::e_keysym = FL_Button + xevent.xbutton.button;
@@ -2286,6 +2494,7 @@ Fl_X* Fl_X::set_xid(Fl_Window* win, Window winxid) {
   xp->w = win; win->i = xp;
   xp->next = Fl_X::first;
   xp->region = 0;
+  xp->damage_rects = 0;
   win->driver()->wait_for_expose_value = 1;
 #ifdef USE_XDBE
   Fl_X11_Window_Driver::driver(win)->backbuffer_bad = 1;
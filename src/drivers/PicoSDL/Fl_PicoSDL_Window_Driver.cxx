@@ -63,6 +63,7 @@ Fl_X *Fl_PicoSDL_Window_Driver::makeWindow()
   other_xid = 0;
   x->w = pWindow;
   x->region = 0;
+  x->damage_rects = 0;
   if (!pWindow->force_position()) {
     pNativeWindow = SDL_CreateWindow(pWindow->label(), SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, w(), h(), 0);
   } else {
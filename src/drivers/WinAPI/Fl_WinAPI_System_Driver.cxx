@@ -931,6 +931,14 @@ void Fl_WinAPI_System_Driver::gettime(time_t *sec, int *usec) {
   *usec = t.millitm * 1000;
 }
 
+double Fl_WinAPI_System_Driver::monotonic_clock() {
+  static LARGE_INTEGER frequency;
+  LARGE_INTEGER count;
+  if (!frequency.QuadPart) QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&count);
+  return double(count.QuadPart) / double(frequency.QuadPart);
+}
+
 //
 // End of "$Id$".
 //
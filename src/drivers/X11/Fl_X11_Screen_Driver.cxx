@@ -23,6 +23,8 @@
 #include "Fl_X11_Window_Driver.H"
 #include "../Xlib/Fl_Xlib_Graphics_Driver.H"
 #include <FL/Fl.H>
+#include <FL/Fl_System_Driver.H>
+#include <FL/Fl_Profiler.H>
 #include <FL/x.H>
 #include <FL/fl_ask.H>
 #include <FL/Fl_Box.H>
@@ -52,6 +54,7 @@
 
 extern Atom fl_NET_WORKAREA;
 extern XIC fl_xim_ic; // in Fl_x.cxx
+extern void fl_flush_frame(); // in Fl.cxx
 
 // these are set by Fl::args() and override any system colors: from Fl_get_system_colors.cxx
 extern const char *fl_fg;
@@ -65,38 +68,119 @@ extern const char *fl_bg2;
 
 
 ////////////////////////////////////////////////////////////////////////
-// Timeouts are stored in a sorted list (*first_timeout), so only the
-// first one needs to be checked to see if any should be called.
-// Allocated, but unused (free) Timeout structs are stored in another
-// linked list (*free_timeout).
+// Timeouts are stored in a binary min-heap (*timeout_heap) ordered by
+// their absolute deadline, so only the first one needs to be checked to
+// see if any should be called. Deadlines are measured on a monotonic
+// clock, so changing the wall clock does not fire or delay timeouts, and
+// pending timeouts never have to be adjusted when time elapses.
+// Every pending Timeout is also linked into a hash table keyed by its
+// (cb, arg) pair, so has_timeout() and remove_timeout() do not have to
+// scan the heap. Allocated, but unused (free) Timeout structs are stored
+// in another linked list (*free_timeout).
 
 struct Timeout {
-  double time;
+  double time;          // absolute deadline, see monotonic_clock()
+  unsigned long seq;    // keeps timeouts with equal deadlines in FIFO order
   void (*cb)(void*);
   void* arg;
-  Timeout* next;
+  int index;            // position in timeout_heap
+  Timeout* next;        // next in hash chain, or in free list
 };
-static Timeout* first_timeout, *free_timeout;
-
-// I avoid the overhead of getting the current time when we have no
-// timeouts by setting this flag instead of getting the time.
-// In this case calling elapse_timeouts() does nothing, but records
-// the current time, and the next call will actually elapse time.
-static char reset_clock = 1;
-
-static void elapse_timeouts() {
-  static struct timeval prevclock;
-  struct timeval newclock;
-  gettimeofday(&newclock, NULL);
-  double elapsed = newclock.tv_sec - prevclock.tv_sec +
-    (newclock.tv_usec - prevclock.tv_usec)/1000000.0;
-  prevclock.tv_sec = newclock.tv_sec;
-  prevclock.tv_usec = newclock.tv_usec;
-  if (reset_clock) {
-    reset_clock = 0;
-  } else if (elapsed > 0) {
-    for (Timeout* t = first_timeout; t; t = t->next) t->time -= elapsed;
+static Timeout** timeout_heap;
+static int num_timeouts, alloc_timeouts;
+static Timeout** timeout_hash;
+static int timeout_hash_size; // always a power of 2
+static Timeout* free_timeout;
+static unsigned long timeout_seq;
+
+// Clock value used as the base for new timeouts. It is updated by
+// add_timeout() and, before each callback, by wait(), so that
+// repeat_timeout() is relative to the time the timeout was due.
+static double current_clock;
+
+static inline double monotonic_clock() {
+  return Fl::system_driver()->monotonic_clock();
+}
+
+static inline bool timeout_before(const Timeout* a, const Timeout* b) {
+  return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static void timeout_sift_up(int i) {
+  Timeout* t = timeout_heap[i];
+  while (i > 0) {
+    int parent = (i-1)/2;
+    if (!timeout_before(t, timeout_heap[parent])) break;
+    timeout_heap[i] = timeout_heap[parent];
+    timeout_heap[i]->index = i;
+    i = parent;
+  }
+  timeout_heap[i] = t;
+  t->index = i;
+}
+
+static void timeout_sift_down(int i) {
+  Timeout* t = timeout_heap[i];
+  for (;;) {
+    int child = 2*i+1;
+    if (child >= num_timeouts) break;
+    if (child+1 < num_timeouts && timeout_before(timeout_heap[child+1], timeout_heap[child]))
+      child++;
+    if (!timeout_before(timeout_heap[child], t)) break;
+    timeout_heap[i] = timeout_heap[child];
+    timeout_heap[i]->index = i;
+    i = child;
+  }
+  timeout_heap[i] = t;
+  t->index = i;
+}
+
+static inline unsigned timeout_hash_key(void (*cb)(void*), void* arg) {
+  fl_uintptr_t h = (fl_uintptr_t)cb * 31 + (fl_uintptr_t)arg;
+  h ^= h >> 16;
+  h *= 0x45d9f3b;
+  h ^= h >> 16;
+  return (unsigned)h;
+}
+
+static void timeout_hash_resize(int size) {
+  Timeout** table = (Timeout**)calloc(size, sizeof(Timeout*));
+  for (int i = 0; i < timeout_hash_size; i++) {
+    Timeout* t = timeout_hash[i];
+    while (t) {
+      Timeout* next = t->next;
+      unsigned h = timeout_hash_key(t->cb, t->arg) & (size-1);
+      t->next = table[h];
+      table[h] = t;
+      t = next;
+    }
+  }
+  free(timeout_hash);
+  timeout_hash = table;
+  timeout_hash_size = size;
+}
+
+// Removes timeout from the heap and moves it to the free list.
+// The caller must already have unlinked it from its hash chain.
+static void timeout_release(Timeout* t) {
+  int i = t->index;
+  Timeout* last = timeout_heap[--num_timeouts];
+  if (last != t) {
+    timeout_heap[i] = last;
+    last->index = i;
+    if (i > 0 && timeout_before(last, timeout_heap[(i-1)/2])) timeout_sift_up(i);
+    else timeout_sift_down(i);
   }
+  t->next = free_timeout;
+  free_timeout = t;
+}
+
+// Unlinks timeout from its hash chain and removes it from the heap.
+static void timeout_unlink(Timeout* t) {
+  Timeout** p = timeout_hash + (timeout_hash_key(t->cb, t->arg) & (timeout_hash_size-1));
+  while (*p != t) p = &((*p)->next);
+  *p = t->next;
+  timeout_release(t);
 }
 
 
@@ -446,24 +530,24 @@ double Fl_X11_Screen_Driver::wait(double time_to_wait)
 {
   static char in_idle;
 
-  if (first_timeout) {
-    elapse_timeouts();
+  if (num_timeouts) {
+    double now = monotonic_clock();
     Timeout *t;
-    while ((t = first_timeout)) {
-      if (t->time > 0) break;
-      // The first timeout in the array has expired.
-      missed_timeout_by = t->time;
-      // We must remove timeout from array before doing the callback:
+    while (num_timeouts) {
+      t = timeout_heap[0];
+      if (t->time > now) break;
+      // The first timeout in the heap has expired.
+      missed_timeout_by = t->time - now;
+      current_clock = now;
+      // We must remove timeout from heap before doing the callback:
       void (*cb)(void*) = t->cb;
       void *argp = t->arg;
-      first_timeout = t->next;
-      t->next = free_timeout;
-      free_timeout = t;
+      timeout_unlink(t);
       // Now it is safe for the callback to do add_timeout:
+      double t0 = Fl_Profiler::start_();
       cb(argp);
+      if (t0) Fl_Profiler::stop_(Fl_Profiler::TIMEOUT, (Fl_Profiler::Function)cb, 0, t0);
     }
-  } else {
-    reset_clock = 1; // we are not going to check the clock
   }
   Fl::run_checks();
   if (Fl::idle) {
@@ -475,16 +559,18 @@ double Fl_X11_Screen_Driver::wait(double time_to_wait)
     // the idle function may turn off idle, we can then wait:
     if (Fl::idle) time_to_wait = 0.0;
   }
-  if (first_timeout && first_timeout->time < time_to_wait)
-    time_to_wait = first_timeout->time;
+  if (num_timeouts) {
+    double delay = timeout_heap[0]->time - monotonic_clock();
+    if (delay < time_to_wait) time_to_wait = delay;
+  }
   if (time_to_wait <= 0.0) {
     // do flush second so that the results of events are visible:
     int ret = this->poll_or_select_with_delay(0.0);
-    Fl::flush();
+    fl_flush_frame();
     return ret;
   } else {
     // do flush first so that user sees the display:
-    Fl::flush();
+    fl_flush_frame();
     if (Fl::idle && !in_idle) // 'idle' may have been set within flush()
       time_to_wait = 0.0;
     return this->poll_or_select_with_delay(time_to_wait);
@@ -494,16 +580,30 @@ double Fl_X11_Screen_Driver::wait(double time_to_wait)
 
 int Fl_X11_Screen_Driver::ready()
 {
-  if (first_timeout) {
-    elapse_timeouts();
-    if (first_timeout->time <= 0) return 1;
-  } else {
-    reset_clock = 1;
-  }
+  if (num_timeouts && timeout_heap[0]->time <= monotonic_clock()) return 1;
   return this->poll_or_select();
 }
 
 
+// notes whether the X queue holds an input event, without removing events:
+static Bool find_input_event(Display*, XEvent *e, XPointer found) {
+  switch (e->type) {
+    case KeyPress: case KeyRelease: case ButtonPress: case ButtonRelease:
+    case MotionNotify:
+      *(int*)found = 1;
+  }
+  return False;
+}
+
+int Fl_X11_Screen_Driver::input_pending()
+{
+  if (!fl_display || !XEventsQueued(fl_display, QueuedAfterReading)) return 0;
+  int found = 0;
+  XEvent e;
+  XCheckIfEvent(fl_display, &e, find_input_event, (XPointer)&found);
+  return found;
+}
+
 extern void fl_fix_focus(); // in Fl.cxx
 
 
@@ -637,33 +737,43 @@ const char *Fl_X11_Screen_Driver::get_system_scheme()
 //
 
 void Fl_X11_Screen_Driver::add_timeout(double time, Fl_Timeout_Handler cb, void *argp) {
-  elapse_timeouts();
+  current_clock = monotonic_clock();
   repeat_timeout(time, cb, argp);
 }
 
 void Fl_X11_Screen_Driver::repeat_timeout(double time, Fl_Timeout_Handler cb, void *argp) {
   time += missed_timeout_by; if (time < -.05) time = 0;
+  if (num_timeouts >= alloc_timeouts) {
+    alloc_timeouts = alloc_timeouts ? 2*alloc_timeouts : 32;
+    timeout_heap = (Timeout**)realloc(timeout_heap, alloc_timeouts*sizeof(Timeout*));
+  }
+  if (num_timeouts >= timeout_hash_size)
+    timeout_hash_resize(timeout_hash_size ? 2*timeout_hash_size : 32);
   Timeout* t = free_timeout;
   if (t) {
       free_timeout = t->next;
   } else {
       t = new Timeout;
   }
-  t->time = time;
+  t->time = current_clock + time;
+  t->seq = timeout_seq++;
   t->cb = cb;
   t->arg = argp;
-  // insert-sort the new timeout:
-  Timeout** p = &first_timeout;
-  while (*p && (*p)->time <= time) p = &((*p)->next);
-  t->next = *p;
-  *p = t;
+  unsigned h = timeout_hash_key(cb, argp) & (timeout_hash_size-1);
+  t->next = timeout_hash[h];
+  timeout_hash[h] = t;
+  t->index = num_timeouts++;
+  timeout_heap[t->index] = t;
+  timeout_sift_up(t->index);
 }
 
 /**
   Returns true if the timeout exists and has not been called yet.
 */
 int Fl_X11_Screen_Driver::has_timeout(Fl_Timeout_Handler cb, void *argp) {
-  for (Timeout* t = first_timeout; t; t = t->next)
+  if (!num_timeouts) return 0;
+  unsigned h = timeout_hash_key(cb, argp) & (timeout_hash_size-1);
+  for (Timeout* t = timeout_hash[h]; t; t = t->next)
     if (t->cb == cb && t->arg == argp) return 1;
   return 0;
 }
@@ -676,14 +786,20 @@ int Fl_X11_Screen_Driver::has_timeout(Fl_Timeout_Handler cb, void *argp) {
 	This may change in the future.
 */
 void Fl_X11_Screen_Driver::remove_timeout(Fl_Timeout_Handler cb, void *argp) {
-  for (Timeout** p = &first_timeout; *p;) {
-    Timeout* t = *p;
-    if (t->cb == cb && (t->arg == argp || !argp)) {
-      *p = t->next;
-      t->next = free_timeout;
-      free_timeout = t;
-    } else {
-      p = &(t->next);
+  if (!num_timeouts) return;
+  // with a NULL argp all timeouts using cb are removed, so every
+  // chain must be searched:
+  int first = 0, last = timeout_hash_size - 1;
+  if (argp) first = last = timeout_hash_key(cb, argp) & (timeout_hash_size-1);
+  for (int h = first; h <= last; h++) {
+    for (Timeout** p = timeout_hash + h; *p;) {
+      Timeout* t = *p;
+      if (t->cb == cb && (t->arg == argp || !argp)) {
+        *p = t->next;
+        timeout_release(t);
+      } else {
+        p = &(t->next);
+      }
     }
   }
 }
@@ -229,6 +229,10 @@ void Fl_X11_Window_Driver::flush_double(int erase_overlay)
       other_xid = fl_create_offscreen(w(), h());
     pWindow->clear_damage(FL_DAMAGE_ALL);
   }
+  // keep the damaged rectangles, fl_clip_region() takes the region:
+  int nrects = (i->region && !erase_overlay) ? i->damage_rects : 0;
+  Fl_Rect rects[Fl_X::MAX_DAMAGE_RECTS];
+  for (int n = 0; n < nrects; n++) rects[n] = i->damage_rect[n];
     if (pWindow->damage() & ~FL_DAMAGE_EXPOSE) {
       fl_clip_region(i->region); i->region = 0;
       fl_window = other_xid;
@@ -236,8 +240,15 @@ void Fl_X11_Window_Driver::flush_double(int erase_overlay)
       fl_window = i->xid;
     }
   if (erase_overlay) fl_clip_region(0);
+  if (!other_xid) return;
+  if (nrects) { // copy only the damaged rectangles
+    for (int n = 0; n < nrects; n++)
+      fl_copy_offscreen(rects[n].x(), rects[n].y(), rects[n].w(), rects[n].h(),
+                        other_xid, rects[n].x(), rects[n].y());
+    return;
+  }
   int X,Y,W,H; fl_clip_box(0,0,w(),h(),X,Y,W,H);
-  if (other_xid) fl_copy_offscreen(X, Y, W, H, other_xid, X, Y);
+  fl_copy_offscreen(X, Y, W, H, other_xid, X, Y);
 }
 
 
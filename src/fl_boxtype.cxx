@@ -396,6 +396,22 @@ int Fl::box_dw(Fl_Boxtype t) {return fl_box_table[t].dw;}
 */
 int Fl::box_dh(Fl_Boxtype t) {return fl_box_table[t].dh;}
 
+/**
+  Returns non-zero if the given boxtype fills its whole rectangle.
+
+  This is true for the boxtypes that are currently drawn by the square
+  box functions, for instance FL_FLAT_BOX, FL_UP_BOX or FL_BORDER_BOX with
+  the default scheme. Frames, rounded boxes and boxtypes set with
+  Fl::set_boxtype() to other functions are not opaque.
+*/
+int Fl::box_opaque(Fl_Boxtype t) {
+  if (!fl_box_table[t].set) return 0;
+  Fl_Box_Draw_F *f = fl_box_table[t].f;
+  return f == fl_flat_box || f == fl_up_box || f == fl_down_box ||
+         f == fl_thin_up_box || f == fl_thin_down_box ||
+         f == fl_engraved_box || f == fl_embossed_box || f == fl_border_box;
+}
+
 /**
   Sets the drawing function for a given box type.
   \param[in] t box type
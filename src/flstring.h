@@ -89,6 +89,12 @@ FL_EXPORT extern size_t fl_strlcpy(char *, const char *, size_t);
  */
 FL_EXPORT extern int fl_ascii_strcasecmp(const char *s, const char *t);
 
+/*
+ * String compare function that compares the numbers in the strings by
+ * value, as fl_numericsort() (cs != 0) and fl_casenumericsort() (cs == 0) do
+ */
+FL_EXPORT extern int fl_numeric_strcmp(const char *a, const char *b, int cs);
+
 #  ifdef __cplusplus
 }
 #  endif /* __cplusplus */
@@ -20,15 +20,15 @@
 #include <stdlib.h>
 #include <FL/platform_types.h>
 #include <FL/filename.H>
+#include "flstring.h"
 
 /*
- * 'numericsort()' - Compare two directory entries, possibly with
- *                   a case-insensitive comparison...
+ * 'fl_numeric_strcmp()' - Compare two strings, comparing the numbers they
+ *                         contain by value, possibly with a case-insensitive
+ *                         comparison...
  */
 
-static int numericsort(struct dirent **A, struct dirent **B, int cs) {
-  const char* a = (*A)->d_name;
-  const char* b = (*B)->d_name;
+int fl_numeric_strcmp(const char *a, const char *b, int cs) {
   int ret = 0;
   for (;;) {
     if (isdigit(*a & 255) && isdigit(*b & 255)) {
@@ -64,7 +64,7 @@ static int numericsort(struct dirent **A, struct dirent **B, int cs) {
  */
 
 int fl_casenumericsort(struct dirent **A, struct dirent **B) {
-  return numericsort(A, B, 0);
+  return fl_numeric_strcmp((*A)->d_name, (*B)->d_name, 0);
 }
 
 /*
@@ -72,7 +72,7 @@ int fl_casenumericsort(struct dirent **A, struct dirent **B) {
  */
 
 int fl_numericsort(struct dirent **A, struct dirent **B) {
-  return numericsort(A, B, 1);
+  return fl_numeric_strcmp((*A)->d_name, (*B)->d_name, 1);
 }
 
 /*